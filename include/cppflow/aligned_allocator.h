@@ -0,0 +1,61 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_ALIGNED_ALLOCATOR_H__
+#define __CPPFLOW2_ALIGNED_ALLOCATOR_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+
+namespace cppflow {
+
+// Alignment TensorFlow's CPU allocator gives tensor buffers. Buffers handed
+// to TF_NewTensor with less alignment may be copied by TensorFlow.
+inline constexpr std::size_t kTensorAlignment = 64;
+
+inline bool is_tensor_aligned(const void* data) {
+    return reinterpret_cast<std::uintptr_t>(data) % kTensorAlignment == 0;
+}
+
+/**
+ * @class AlignedAllocator
+ * @brief Allocates storage aligned for zero-copy use as a tensor buffer
+ */
+template<typename T>
+class AlignedAllocator {
+public:
+    using value_type = T;
+
+    AlignedAllocator() noexcept = default;
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) noexcept {
+    }
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(::operator new(
+            n * sizeof(T), std::align_val_t {kTensorAlignment}));
+    }
+
+    void deallocate(T* p, std::size_t) noexcept {
+        ::operator delete(p, std::align_val_t {kTensorAlignment});
+    }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U>&) const noexcept {
+        return true;
+    }
+};
+
+/**
+ * A vector whose data can always be moved into a Tensor without a copy
+ */
+template<typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+}    // namespace cppflow
+
+#endif
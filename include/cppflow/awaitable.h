@@ -0,0 +1,137 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_AWAITABLE_H__
+#define __CPPFLOW2_AWAITABLE_H__
+
+#include "executor.h"
+
+#include <atomic>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+
+namespace cppflow {
+
+/**
+ * Hands a continuation to the caller's event loop. An empty scheduler
+ * resumes the coroutine directly on the worker thread that did the work.
+ */
+using Scheduler = std::function<void(std::function<void()>)>;
+
+/**
+ * @return A scheduler resuming coroutines on an Executor
+ */
+inline Scheduler resume_on(Executor& executor) {
+    return [&executor](std::function<void()> continuation) {
+        executor.submit(std::move(continuation));
+    };
+}
+
+/**
+ * @class Awaitable
+ * @brief Runs a blocking TensorFlow call on an Executor from a coroutine
+ *
+ * Suspending submits the work to the worker executor; once it finishes the
+ * coroutine is resumed through the scheduler, and co_await returns the
+ * result or rethrows what the work threw. If the executor rejects the work,
+ * co_await throws RejectedError without suspending. If the scheduler throws,
+ * the coroutine is resumed on the worker thread instead of being lost,
+ * unless the continuation it already queued claims it first: the coroutine
+ * is resumed exactly once.
+ */
+template<typename Result>
+class Awaitable {
+public:
+    Awaitable(std::function<Result()> work, Scheduler scheduler,
+              Executor& executor)
+        : work_(std::move(work)),
+          scheduler_(std::move(scheduler)),
+          executor_(executor) {
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        executor_.submit([this, handle] {
+            try {
+                if constexpr (std::is_void_v<Result>) {
+                    work_();
+                } else {
+                    result_.emplace(work_());
+                }
+            } catch (...) {
+                error_ = std::current_exception();
+            }
+
+            // Resuming may destroy this Awaitable, nothing of it is used
+            // once the continuation is handed off
+            auto scheduler = std::move(scheduler_);
+            if (!scheduler) {
+                handle.resume();
+                return;
+            }
+            // Only the first resume claims the coroutine, in case the
+            // scheduler queued the continuation and threw afterwards
+            auto resumed = std::make_shared<std::atomic<bool>>(false);
+            auto resume = [handle, resumed] {
+                if (!resumed->exchange(true)) {
+                    handle.resume();
+                }
+            };
+            try {
+                scheduler(resume);
+            } catch (...) {
+                resume();
+            }
+        });
+    }
+
+    Result await_resume() {
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        if constexpr (!std::is_void_v<Result>) {
+            return std::move(*result_);
+        }
+    }
+
+private:
+    using Storage
+        = std::conditional_t<std::is_void_v<Result>, bool, Result>;
+
+    std::function<Result()> work_;
+    Scheduler scheduler_;
+    Executor& executor_;
+    std::optional<Storage> result_;
+    std::exception_ptr error_;
+};
+
+/**
+ * Wraps any blocking callable, such as a chain of eager ops, so that it can
+ * be co_awaited:
+ *
+ *     auto y = co_await cppflow::awaitable([&] { return ops::Add(a, b) * c; });
+ *
+ * @param work The callable, run on an executor thread
+ * @param scheduler Where to resume the coroutine
+ * @param executor The worker pool to run on
+ */
+template<typename Func>
+Awaitable<std::invoke_result_t<Func>> awaitable(
+    Func&& work, Scheduler scheduler = {},
+    Executor& executor = *default_executor()) {
+    return {std::forward<Func>(work), std::move(scheduler), executor};
+}
+
+}    // namespace cppflow
+
+#endif
@@ -0,0 +1,347 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_BATCHER_H__
+#define __CPPFLOW2_BATCHER_H__
+
+#include "runner.h"
+#include "tensor.h"
+
+#include <tensorflow/c/tf_tensor.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace cppflow {
+
+struct BatcherOptions {
+    // Maximum number of rows (sum of the leading dimensions of the queued
+    // requests) fed to a single run
+    std::size_t max_batch_size = 32;
+    // Maximum time the oldest queued request waits for others to join it
+    std::chrono::microseconds max_queue_delay {1000};
+    // If not empty, every batch is zero-padded up to the smallest of these
+    // sizes that fits it. Useful for models compiled for fixed shapes
+    std::vector<int64_t> allowed_batch_sizes;
+};
+
+/**
+ * @class Batcher
+ * @brief Groups concurrent requests into a single run of a prepared Runner
+ *
+ * Every request is a list of tensors, one per runner input, whose first
+ * dimension is the batch dimension (usually 1). Queued requests are
+ * concatenated along that dimension on the host, executed with one
+ * TF_SessionRun, and the outputs are split back into each request's future.
+ * Only requests whose inputs share dtypes and all but the first dimension
+ * are batched together, so a request of another shape runs in a batch of
+ * its own instead of failing its neighbours. Only fixed-size datatypes can
+ * be batched.
+ */
+class Batcher {
+public:
+    explicit Batcher(Runner runner, BatcherOptions options = {});
+
+    /**
+     * Queues a request
+     * @param inputs One tensor per runner input, batch dimension first
+     * @return A future holding one tensor per runner output
+     * @throw std::runtime_error if the inputs cannot be batched, or have
+     * more than max_batch_size rows while allowed_batch_sizes is set
+     */
+    std::future<std::vector<Tensor>> submit(std::vector<Tensor> inputs);
+
+    std::vector<Tensor> operator()(std::vector<Tensor> inputs) {
+        return submit(std::move(inputs)).get();
+    }
+
+    ~Batcher();
+    Batcher(const Batcher&) = delete;
+    Batcher& operator=(const Batcher&) = delete;
+
+private:
+    struct Request {
+        std::vector<Tensor> inputs;
+        int64_t rows;
+        // Dtypes and inner dims of the inputs, see append_batch_signature()
+        std::string signature;
+        std::promise<std::vector<Tensor>> promise;
+        std::chrono::steady_clock::time_point enqueued;
+    };
+
+    void loop();
+    void process(std::vector<Request>& batch);
+    int64_t padded_size(int64_t rows) const;
+
+private:
+    Runner runner_;
+    BatcherOptions options_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Request> queue_;
+    int64_t queued_rows_ {0};
+    bool stop_ {false};
+    std::thread worker_;
+};
+
+}    // namespace cppflow
+
+
+namespace cppflow {
+
+namespace detail {
+
+inline std::vector<int64_t> tensor_dims(const TF_Tensor* tensor) {
+    auto dims = std::vector<int64_t>(TF_NumDims(tensor));
+    for (std::size_t i = 0; i < dims.size(); ++i) {
+        dims[i] = TF_Dim(tensor, static_cast<int>(i));
+    }
+    return dims;
+}
+
+inline void check_batchable(const TF_Tensor* tensor) {
+    if (TF_TensorType(tensor) == TF_STRING
+        || TF_TensorType(tensor) == TF_RESOURCE
+        || TF_TensorType(tensor) == TF_VARIANT) {
+        throw std::runtime_error("Tensors of type "
+                                 + to_string(TF_TensorType(tensor))
+                                 + " cannot be batched");
+    }
+    if (TF_NumDims(tensor) == 0) {
+        throw std::runtime_error("Batched tensors need a batch dimension");
+    }
+}
+
+// Requests can be concatenated when their signatures are equal
+inline void append_batch_signature(std::string& signature,
+                                   const TF_Tensor* tensor) {
+    signature += std::to_string(TF_TensorType(tensor));
+    signature += ':';
+    for (int d = 1; d < TF_NumDims(tensor); ++d) {
+        signature += std::to_string(TF_Dim(tensor, d));
+        signature += ',';
+    }
+    signature += ';';
+}
+
+}    // namespace detail
+
+inline Batcher::Batcher(Runner runner, BatcherOptions options)
+    : runner_(std::move(runner)), options_(std::move(options)) {
+    if (options_.max_batch_size == 0) {
+        throw std::runtime_error("max_batch_size must be greater than zero");
+    }
+    std::sort(options_.allowed_batch_sizes.begin(),
+              options_.allowed_batch_sizes.end());
+    if (!options_.allowed_batch_sizes.empty()
+        && options_.allowed_batch_sizes.back()
+               < static_cast<int64_t>(options_.max_batch_size)) {
+        throw std::runtime_error(
+            "The largest allowed batch size must not be smaller than "
+            "max_batch_size");
+    }
+    worker_ = std::thread {&Batcher::loop, this};
+}
+
+inline Batcher::~Batcher() {
+    {
+        auto lock = std::lock_guard {mutex_};
+        stop_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+}
+
+inline std::future<std::vector<Tensor>> Batcher::submit(
+    std::vector<Tensor> inputs) {
+    if (inputs.size() != runner_.inputs().size()) {
+        throw std::runtime_error(
+            "Batcher expects " + std::to_string(runner_.inputs().size())
+            + " inputs but got " + std::to_string(inputs.size()));
+    }
+
+    auto rows = int64_t {-1};
+    auto signature = std::string {};
+    for (const auto& input : inputs) {
+        auto tensor = input.get_tensor();
+        detail::check_batchable(tensor.get());
+        if (rows >= 0 && TF_Dim(tensor.get(), 0) != rows) {
+            throw std::runtime_error(
+                "All inputs of a request must have the same batch size");
+        }
+        rows = TF_Dim(tensor.get(), 0);
+        detail::append_batch_signature(signature, tensor.get());
+    }
+    if (rows == 0) {
+        throw std::runtime_error("Batched requests need at least one row");
+    }
+    // It would run on its own, with no allowed size to pad it to
+    if (!options_.allowed_batch_sizes.empty()
+        && rows > static_cast<int64_t>(options_.max_batch_size)) {
+        throw std::runtime_error(
+            "Request of " + std::to_string(rows)
+            + " rows exceeds max_batch_size of "
+            + std::to_string(options_.max_batch_size));
+    }
+
+    auto request = Request {std::move(inputs), rows, std::move(signature), {},
+                            std::chrono::steady_clock::now()};
+    auto future = request.promise.get_future();
+    {
+        auto lock = std::lock_guard {mutex_};
+        if (stop_) {
+            throw std::runtime_error("Batcher is shutting down");
+        }
+        queued_rows_ += request.rows;
+        queue_.emplace_back(std::move(request));
+    }
+    cv_.notify_one();
+
+    return future;
+}
+
+inline int64_t Batcher::padded_size(int64_t rows) const {
+    const auto& sizes = options_.allowed_batch_sizes;
+    auto it = std::lower_bound(sizes.begin(), sizes.end(), rows);
+    return it == sizes.end() ? rows : *it;
+}
+
+inline void Batcher::loop() {
+    const auto max_rows = static_cast<int64_t>(options_.max_batch_size);
+
+    while (true) {
+        auto batch = std::vector<Request> {};
+        {
+            auto lock = std::unique_lock {mutex_};
+            cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+
+            // Wait until the batch is full, the oldest request is due, or we
+            // are asked to stop (pending requests are still served)
+            auto deadline = queue_.front().enqueued + options_.max_queue_delay;
+            cv_.wait_until(lock, deadline, [&] {
+                return stop_ || queued_rows_ >= max_rows;
+            });
+
+            // Take the oldest request and the ones after it that can be
+            // concatenated with it, leaving the others queued in order
+            auto signature = queue_.front().signature;
+            auto rows = int64_t {0};
+            for (auto it = queue_.begin(); it != queue_.end();) {
+                if (it->signature != signature) {
+                    ++it;
+                    continue;
+                }
+                if (!batch.empty() && rows + it->rows > max_rows) {
+                    break;
+                }
+                rows += it->rows;
+                queued_rows_ -= it->rows;
+                batch.emplace_back(std::move(*it));
+                it = queue_.erase(it);
+            }
+        }
+
+        process(batch);
+    }
+}
+
+inline void Batcher::process(std::vector<Request>& batch) {
+    try {
+        auto rows = int64_t {0};
+        for (const auto& request : batch) {
+            rows += request.rows;
+        }
+        auto padded_rows = padded_size(rows);
+
+        // Concatenate every input along the first dimension
+        auto inputs = std::vector<Tensor> {};
+        inputs.reserve(runner_.inputs().size());
+        for (std::size_t i = 0; i < runner_.inputs().size(); ++i) {
+            auto first = batch.front().inputs[i].get_tensor();
+            auto type = TF_TensorType(first.get());
+            auto dims = detail::tensor_dims(first.get());
+
+            auto row_bytes = static_cast<std::size_t>(TF_DataTypeSize(type));
+            for (std::size_t d = 1; d < dims.size(); ++d) {
+                row_bytes *= static_cast<std::size_t>(dims[d]);
+            }
+
+            dims[0] = padded_rows;
+            auto* tensor
+                = TF_AllocateTensor(type, dims.data(),
+                                    static_cast<int>(dims.size()),
+                                    row_bytes * padded_rows);
+            auto* dst = static_cast<char*>(TF_TensorData(tensor));
+            auto input = Tensor {tensor};
+
+            for (const auto& request : batch) {
+                auto src = request.inputs[i].get_tensor();
+                auto bytes = TF_TensorByteSize(src.get());
+                std::memcpy(dst, TF_TensorData(src.get()), bytes);
+                dst += bytes;
+            }
+            std::memset(dst, 0, row_bytes * (padded_rows - rows));
+
+            inputs.emplace_back(std::move(input));
+        }
+
+        auto outputs = runner_.run(inputs);
+
+        // Split every output back into its requests
+        auto results = std::vector<std::vector<Tensor>>(batch.size());
+        for (const auto& output : outputs) {
+            auto tensor = output.get_tensor();
+            detail::check_batchable(tensor.get());
+            auto type = TF_TensorType(tensor.get());
+            auto dims = detail::tensor_dims(tensor.get());
+            if (dims[0] != padded_rows) {
+                throw std::runtime_error(
+                    "Batched output does not have the batch dimension first");
+            }
+
+            auto row_bytes = TF_TensorByteSize(tensor.get())
+                             / static_cast<std::size_t>(padded_rows);
+            const auto* src = static_cast<const char*>(
+                TF_TensorData(tensor.get()));
+
+            for (std::size_t r = 0; r < batch.size(); ++r) {
+                dims[0] = batch[r].rows;
+                auto bytes = row_bytes * batch[r].rows;
+                auto* slice
+                    = TF_AllocateTensor(type, dims.data(),
+                                        static_cast<int>(dims.size()), bytes);
+                std::memcpy(TF_TensorData(slice), src, bytes);
+                src += bytes;
+                results[r].emplace_back(Tensor {slice});
+            }
+        }
+
+        for (std::size_t r = 0; r < batch.size(); ++r) {
+            batch[r].promise.set_value(std::move(results[r]));
+        }
+    } catch (...) {
+        for (auto& request : batch) {
+            request.promise.set_exception(std::current_exception());
+        }
+    }
+}
+
+}    // namespace cppflow
+
+#endif
@@ -7,9 +7,18 @@
 
 #include <tensorflow/c/c_api.h>
 #include <tensorflow/c/eager/c_api.h>
+#include <tensorflow/c/eager/c_api_experimental.h>
 
+#include <atomic>
+#include <cstdint>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 
 
@@ -26,12 +35,25 @@ class context {
 public:
     static TFE_Context* get_context();
     static TF_Status* get_status();
+    // Identifies the global context, ids are never reused
+    static uint64_t get_id();
 
 private:
     TFE_Context* tfe_context {nullptr};
+    uint64_t id_ {0};
+    bool async_ {false};
 
 public:
-    explicit context(TFE_ContextOptions* opts = nullptr);
+    /**
+     * @param opts Options of the TFE_Context, the defaults if nullptr
+     * @param async Enqueue eager ops and return before they run, each thread
+     * on its own executor, see sync(). Enables the async option of `opts`.
+     */
+    explicit context(TFE_ContextOptions* opts = nullptr, bool async = false);
+
+    bool is_async() const {
+        return async_;
+    }
 
     context(context const&) = delete;
     context& operator=(context const&) = delete;
@@ -50,43 +72,392 @@ inline context& get_global_context() {
     return global_context;
 }
 
+/**
+ * Waits for the ops the calling thread enqueued on an async context. Reading
+ * the values of a tensor also waits, but only for the ops producing it.
+ *
+ *     cppflow::get_global_context() = cppflow::context(nullptr, true);
+ *     auto y = ops::MatMul(ops::Relu(x), w);    // returns immediately
+ *     cppflow::sync();
+ *
+ * The error of a failed op is thrown from here, from reading a tensor that
+ * depends on it, or from the next op the thread runs. The thread's executor
+ * then accepts ops again.
+ * @throw std::runtime_error if an enqueued op failed
+ */
+inline void sync();
+
+namespace detail {
+
+/**
+ * A TFE_Op taken from the calling thread's cache, or created if the cache
+ * has none by that name. It goes back to the cache when destroyed, reset
+ * with TFE_OpReset so it holds on to no inputs. This only saves allocating
+ * the EagerOperation on every eager op call, TFE_OpReset still looks up the
+ * op definition and its attribute types.
+ */
+class CachedOp {
+public:
+    explicit CachedOp(const char* name);
+    ~CachedOp();
+
+    CachedOp(const CachedOp&) = delete;
+    CachedOp& operator=(const CachedOp&) = delete;
+
+    TFE_Op* get() const {
+        return op_;
+    }
+
+private:
+    const char* name_;
+    TFE_Op* op_ {nullptr};
+};
+
+}    // namespace detail
+
 }    // namespace cppflow
 
 namespace cppflow {
 
+namespace detail {
+
+// Incremented when a context is destroyed, as the ops cached for it become
+// unusable
+inline std::atomic<uint64_t>& context_generation() {
+    static auto generation = std::atomic<uint64_t> {0};
+    return generation;
+}
+
+// The ids of the contexts alive
+struct LiveContexts {
+    std::mutex mutex;
+    std::unordered_set<uint64_t> ids;
+    uint64_t next_id {1};
+};
+
+// Never freed, the global context is destroyed after the other statics
+inline LiveContexts& live_contexts() {
+    static auto* live = new LiveContexts {};
+    return *live;
+}
+
+inline bool context_alive(uint64_t id) {
+    auto& live = live_contexts();
+    auto lock = std::lock_guard {live.mutex};
+    return live.ids.count(id) != 0;
+}
+
+// One idle op per name, for the ops the thread has run
+class OpCache {
+public:
+    // The calling thread's cache, or nullptr once the thread is exiting
+    static OpCache* local() {
+        thread_local OpCache cache;
+        return destroyed() ? nullptr : &cache;
+    }
+
+    ~OpCache() {
+        // Ops of a deleted context must not reach TFE_DeleteOp
+        check_generation();
+        clear();
+        destroyed() = true;
+    }
+
+    TFE_Op* take(std::string_view name) {
+        check_generation();
+        auto op = ops_.find(name);
+        return op == ops_.end() ? nullptr : std::exchange(op->second, nullptr);
+    }
+
+    // Keeps the op unless an op of that name is already cached
+    bool put(std::string_view name, TFE_Op* op) {
+        check_generation();
+        auto cached = ops_.find(name);
+        if (cached == ops_.end()) {
+            ops_.emplace(name, op);
+            return true;
+        }
+        if (cached->second == nullptr) {
+            cached->second = op;
+            return true;
+        }
+        return false;
+    }
+
+    void clear() {
+        for (auto& [name, op] : ops_) {
+            TFE_DeleteOp(op);
+        }
+        ops_.clear();
+    }
+
+    // The id of the context the cached ops belong to
+    uint64_t owner() const {
+        return owner_;
+    }
+
+private:
+    struct Hash : std::hash<std::string_view> {
+        using is_transparent = void;
+    };
+
+    static bool& destroyed() {
+        thread_local bool flag = false;
+        return flag;
+    }
+
+    void check_generation() {
+        auto generation = context_generation().load(std::memory_order_acquire);
+        if (generation == generation_) {
+            return;
+        }
+        if (!context_alive(owner_)) {
+            // The ops belong to a deleted context and cannot be deleted
+            // safely anymore, they are dropped instead
+            ops_.clear();
+            owner_ = context::get_id();
+        }
+        generation_ = generation;
+    }
+
+    std::unordered_map<std::string, TFE_Op*, Hash, std::equal_to<>> ops_;
+    uint64_t owner_ {context::get_id()};
+    uint64_t generation_ {context_generation().load()};
+};
+
+/**
+ * The executor the calling thread enqueues its ops on when the context is
+ * async. Each thread gets its own, so that sync() only waits for the ops of
+ * that thread and an error only stops the thread that caused it.
+ */
+class ThreadExecutor {
+public:
+    // The calling thread's executor, or nullptr once the thread is exiting
+    static ThreadExecutor* local() {
+        thread_local ThreadExecutor executor;
+        return destroyed() ? nullptr : &executor;
+    }
+
+    ~ThreadExecutor() {
+        release();
+        destroyed() = true;
+    }
+
+    // Installs an executor for the thread if the context is async
+    void install();
+
+    // Waits for the pending ops and gives the context back its default
+    // executor for this thread
+    void release();
+
+    // The executor of the current context, or nullptr
+    TFE_Executor* get() {
+        check_generation();
+        return executor_;
+    }
+
+    // Lets the thread run ops again after one of them failed
+    void clear_error() {
+        if (auto* executor = get()) {
+            TFE_ExecutorClearError(executor);
+        }
+    }
+
+    // The id of the context the executor is installed on
+    uint64_t context_id() const {
+        return context_id_;
+    }
+
+private:
+    static bool& destroyed() {
+        thread_local bool flag = false;
+        return flag;
+    }
+
+    void check_generation() {
+        auto generation = context_generation().load(std::memory_order_acquire);
+        if (generation == generation_) {
+            return;
+        }
+        if (context_ && !context_alive(context_id_)) {
+            // Another thread destroyed the context, which waited for the
+            // executors' pending ops and unregistered them, so they are
+            // only deleted
+            TFE_DeleteExecutor(previous_);
+            TFE_DeleteExecutor(executor_);
+            executor_ = nullptr;
+            previous_ = nullptr;
+            context_ = nullptr;
+            context_id_ = 0;
+        }
+        generation_ = generation;
+    }
+
+    TFE_Executor* executor_ {nullptr};
+    // The executor the context used for the thread before, restored later
+    TFE_Executor* previous_ {nullptr};
+    TFE_Context* context_ {nullptr};
+    uint64_t context_id_ {0};
+    uint64_t generation_ {context_generation().load()};
+};
+
+inline void ThreadExecutor::install() {
+    if (get() || !get_global_context().is_async()) {
+        return;
+    }
+    context_ = context::get_context();
+    context_id_ = context::get_id();
+    previous_ = TFE_ContextGetExecutorForThread(context_);
+    executor_ = TFE_NewExecutor(/*is_async=*/true,
+                                /*enable_streaming_enqueue=*/true,
+                                /*in_flight_nodes_limit=*/0);
+    TFE_ContextSetExecutorForThread(context_, executor_);
+}
+
+inline void ThreadExecutor::release() {
+    if (!get()) {
+        return;
+    }
+    // The thread's own status may already be destroyed at thread exit, and
+    // errors of the pending ops are dropped anyway
+    auto status = std::unique_ptr<TF_Status, decltype(&TF_DeleteStatus)> {
+        TF_NewStatus(), TF_DeleteStatus};
+    TFE_ExecutorWaitForAllPendingNodes(executor_, status.get());
+    TFE_ContextSetExecutorForThread(context_, previous_);
+    TFE_DeleteExecutor(previous_);
+    TFE_DeleteExecutor(executor_);
+    executor_ = nullptr;
+    previous_ = nullptr;
+    context_ = nullptr;
+    context_id_ = 0;
+}
+
+inline CachedOp::CachedOp(const char* name) : name_(name) {
+    if (auto* executor = ThreadExecutor::local()) {
+        executor->install();
+    }
+    if (auto* cache = OpCache::local()) {
+        op_ = cache->take(name);
+    }
+    if (!op_) {
+        op_ = TFE_NewOp(context::get_context(), name, context::get_status());
+        status_check(context::get_status());
+    }
+}
+
+inline CachedOp::~CachedOp() {
+    // Errors raised from the status were copied into their exception, so
+    // it can be reused even while one propagates
+    auto* status = context::get_status();
+    auto* cache = OpCache::local();
+    if (cache) {
+        TFE_OpReset(op_, name_, nullptr, status);
+    }
+    if (!cache || TF_GetCode(status) != TF_OK || !cache->put(name_, op_)) {
+        TFE_DeleteOp(op_);
+    }
+}
+
+// Like status_check, but also clears the error of an op that failed on the
+// thread's executor
+inline bool async_status_check(TF_Status* status) {
+    if (TF_GetCode(status) != TF_OK) {
+        if (auto* executor = ThreadExecutor::local()) {
+            executor->clear_error();
+        }
+    }
+    return status_check(status);
+}
+
+}    // namespace detail
+
+inline void sync() {
+    auto* executor = detail::ThreadExecutor::local();
+    if (executor && executor->get()) {
+        TFE_ExecutorWaitForAllPendingNodes(executor->get(),
+                                           context::get_status());
+    } else {
+        // The context's own executor, in case its options were made async
+        // directly
+        TFE_ContextAsyncWait(context::get_context(), context::get_status());
+    }
+    detail::async_status_check(context::get_status());
+}
+
 inline TFE_Context* context::get_context() {
     return get_global_context().tfe_context;
 }
 
+inline uint64_t context::get_id() {
+    return get_global_context().id_;
+}
+
 inline TF_Status* context::get_status() {
     thread_local std::unique_ptr<TF_Status, decltype(&TF_DeleteStatus)>
         local_tf_status(TF_NewStatus(), &TF_DeleteStatus);
     return local_tf_status.get();
 }
 
-inline context::context(TFE_ContextOptions* opts) {
+inline context::context(TFE_ContextOptions* opts, bool async)
+    : async_(async) {
     auto tf_status = context::get_status();
     if (opts == nullptr) {
         std::unique_ptr<TFE_ContextOptions, decltype(&TFE_DeleteContextOptions)>
             new_opts(TFE_NewContextOptions(), &TFE_DeleteContextOptions);
+        TFE_ContextOptionsSetAsync(new_opts.get(), async);
         this->tfe_context = TFE_NewContext(new_opts.get(), tf_status);
     } else {
+        if (async) {
+            TFE_ContextOptionsSetAsync(opts, 1);
+        }
         this->tfe_context = TFE_NewContext(opts, tf_status);
     }
     status_check(tf_status);
+
+    auto& live = detail::live_contexts();
+    auto lock = std::lock_guard {live.mutex};
+    id_ = live.next_id++;
+    live.ids.insert(id_);
 }
 
 inline context::context(context&& ctx) noexcept
-    : tfe_context(std::exchange(ctx.tfe_context, nullptr)) {
+    : tfe_context(std::exchange(ctx.tfe_context, nullptr)),
+      id_(std::exchange(ctx.id_, 0)),
+      async_(ctx.async_) {
 }
 
 inline context& context::operator=(context&& ctx) noexcept {
     tfe_context = std::exchange(ctx.tfe_context, tfe_context);
+    std::swap(id_, ctx.id_);
+    std::swap(async_, ctx.async_);
     return *this;
 }
 
 inline context::~context() {
+    if (this->tfe_context) {
+        // The thread's pending ops finish while their context exists
+        auto* executor = detail::ThreadExecutor::local();
+        if (executor && executor->get() && executor->context_id() == id_) {
+            executor->release();
+        }
+        // Ops cached by this thread are deleted while their context exists
+        auto* cache = detail::OpCache::local();
+        if (cache && cache->owner() == id_) {
+            cache->clear();
+        }
+    }
     TFE_DeleteContext(this->tfe_context);
+
+    if (this->tfe_context) {
+        // Published once the context is gone: other threads then delete
+        // their executors the next time they run an op, or when they exit
+        {
+            auto& live = detail::live_contexts();
+            auto lock = std::lock_guard {live.mutex};
+            live.ids.erase(id_);
+        }
+        detail::context_generation().fetch_add(1, std::memory_order_release);
+    }
 }
 
 }    // namespace cppflow
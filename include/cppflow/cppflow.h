@@ -5,15 +5,38 @@
 #ifndef __CPPFLOW_CPPFLOW_H__
 #define __CPPFLOW_CPPFLOW_H__
 
+#include "aligned_allocator.h"
+#include "awaitable.h"
+#include "batcher.h"
 #include "buffer.h"
 #include "context.h"
 #include "datatype.h"
+#include "dims.h"
+#include "executor.h"
+#include "graph_def.h"
+#include "function.h"
+#include "half.h"
+#include "host_math.h"
+#include "image.h"
 #include "library.h"
+#include "mapped_file.h"
 #include "model.h"
+#include "model_manager.h"
+#include "model_pool.h"
+#include "npy.h"
 #include "ops.h"
+#include "profiler.h"
+#include "proto.h"
 #include "raw_ops.h"
+#include "runner.h"
 #include "session_options.h"
+#include "signature.h"
 #include "tensor.h"
+#include "tensor_builder.h"
+#include "tensor_pool.h"
+#include "tensor_proto.h"
+#include "tensor_view.h"
+#include "warmup.h"
 
 #include <tensorflow/c/c_api.h>
 
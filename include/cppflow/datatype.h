@@ -5,6 +5,8 @@
 #ifndef CPPFLOW2_DATATYPE_H
 #define CPPFLOW2_DATATYPE_H
 
+#include "half.h"
+
 #include <tensorflow/c/tf_datatype.h>
 
 #include <ostream>
@@ -115,6 +117,12 @@ inline constexpr TF_DataType deduce_tf_type() {
     if constexpr (std::is_same_v<T, uint64_t>) {
         return TF_UINT64;
     }
+    if constexpr (std::is_same_v<T, float16>) {
+        return TF_HALF;
+    }
+    if constexpr (std::is_same_v<T, bfloat16>) {
+        return TF_BFLOAT16;
+    }
     if constexpr (std::is_same_v<
                       T, std::string> || std::is_same_v<T, std::string_view>) {
         return TF_STRING;
@@ -125,5 +133,15 @@ inline constexpr TF_DataType deduce_tf_type() {
                               + std::string {typeid(T).name()}};
 }
 
+namespace detail {
+
+// Element types whose values can be read from a tensor buffer directly
+template<typename T>
+inline constexpr bool is_numeric_v
+    = std::is_arithmetic_v<T> || std::is_same_v<T, float16>
+      || std::is_same_v<T, bfloat16>;
+
+}    // namespace detail
+
 }    // namespace cppflow
 #endif    // CPPFLOW2_DATATYPE_H
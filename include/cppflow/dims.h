@@ -0,0 +1,123 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_DIMS_H__
+#define __CPPFLOW2_DIMS_H__
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <vector>
+
+
+namespace cppflow {
+
+/**
+ * @class Dims
+ * @brief The dimensions of a tensor, stored inline up to kInlineRank
+ */
+class Dims {
+public:
+    static constexpr std::size_t kInlineRank = 8;
+
+    Dims() = default;
+    explicit Dims(std::size_t rank) : rank_(rank) {
+        if (rank_ > kInlineRank) {
+            heap_.resize(rank_);
+        }
+    }
+    Dims(std::initializer_list<int64_t> dims) : Dims(dims.size()) {
+        std::copy(dims.begin(), dims.end(), data());
+    }
+    explicit Dims(std::span<const int64_t> dims) : Dims(dims.size()) {
+        std::copy(dims.begin(), dims.end(), data());
+    }
+
+    std::size_t rank() const {
+        return rank_;
+    }
+
+    std::size_t size() const {
+        return rank_;
+    }
+
+    bool empty() const {
+        return rank_ == 0;
+    }
+
+    int64_t* data() {
+        return rank_ > kInlineRank ? heap_.data() : inline_.data();
+    }
+
+    const int64_t* data() const {
+        return rank_ > kInlineRank ? heap_.data() : inline_.data();
+    }
+
+    int64_t& operator[](std::size_t i) {
+        return data()[i];
+    }
+
+    int64_t operator[](std::size_t i) const {
+        return data()[i];
+    }
+
+    const int64_t* begin() const {
+        return data();
+    }
+
+    const int64_t* end() const {
+        return data() + rank_;
+    }
+
+    /**
+     * @return The product of the dimensions, 1 for a scalar
+     */
+    int64_t num_elements() const {
+        auto count = int64_t {1};
+        for (auto dim : *this) {
+            count *= dim;
+        }
+        return count;
+    }
+
+    std::vector<int64_t> to_vector() const {
+        return {begin(), end()};
+    }
+
+    operator std::span<const int64_t>() const {
+        return {data(), rank_};
+    }
+
+    /**
+     * @return The dimensions in the form [2 3], as TensorFlow prints shapes
+     */
+    std::string to_string() const {
+        auto result = std::string {"["};
+        for (std::size_t i = 0; i < rank_; ++i) {
+            if (i > 0) {
+                result += ' ';
+            }
+            result += std::to_string(data()[i]);
+        }
+        result += ']';
+        return result;
+    }
+
+    friend bool operator==(const Dims& lhs, const Dims& rhs) {
+        return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+    }
+
+private:
+    std::size_t rank_ {0};
+    std::array<int64_t, kInlineRank> inline_ {};
+    std::vector<int64_t> heap_;
+};
+
+}    // namespace cppflow
+
+#endif
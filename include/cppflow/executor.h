@@ -0,0 +1,214 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_EXECUTOR_H__
+#define __CPPFLOW2_EXECUTOR_H__
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+
+namespace cppflow {
+
+/**
+ * Thrown when a task is submitted to a full or stopped Executor
+ */
+class RejectedError : public std::runtime_error {
+public:
+    using std::runtime_error::runtime_error;
+};
+
+/**
+ * @class Executor
+ * @brief Fixed-size worker pool with a bounded task queue
+ *
+ * Used to run blocking TensorFlow calls off the caller's thread. When
+ * `max_queue_depth` tasks are already waiting, new submissions are rejected
+ * instead of growing the queue without limit. The destructor runs the tasks
+ * still queued and joins the workers.
+ *
+ * A task that throws does not stop its worker: the exception is passed to
+ * the error handler, and dropped when there is none. Tasks queued through
+ * async() never throw, their exceptions are stored in the future.
+ */
+class Executor {
+public:
+    using ErrorHandler = std::function<void(std::exception_ptr)>;
+
+    explicit Executor(
+        std::size_t num_threads = std::max(1u,
+                                           std::thread::hardware_concurrency()),
+        std::size_t max_queue_depth = 1024);
+
+    /**
+     * Queues a task
+     * @throw RejectedError if the queue is full or the executor is stopping
+     */
+    void submit(std::function<void()> task) {
+        if (!try_submit(std::move(task))) {
+            throw RejectedError("Executor queue is full");
+        }
+    }
+
+    /**
+     * Queues a task
+     * @return false if the queue is full or the executor is stopping
+     */
+    bool try_submit(std::function<void()> task);
+
+    /**
+     * Queues a callable and returns a future to its result
+     * @throw RejectedError if the queue is full or the executor is stopping
+     */
+    template<typename Func>
+    std::future<std::invoke_result_t<Func>> async(Func&& func);
+
+    std::size_t queue_depth() const;
+
+    /**
+     * Sets the function called, from the worker thread, with the exceptions
+     * thrown by tasks. Exceptions it throws in turn are dropped.
+     */
+    void set_error_handler(ErrorHandler handler);
+
+    std::size_t num_threads() const {
+        return workers_.size();
+    }
+
+    std::size_t max_queue_depth() const {
+        return max_queue_depth_;
+    }
+
+    ~Executor();
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+private:
+    void loop();
+
+private:
+    std::size_t max_queue_depth_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> queue_;
+    ErrorHandler error_handler_;
+    bool stop_ {false};
+    std::vector<std::thread> workers_;
+};
+
+/**
+ * Executor used by the asynchronous calls when none is given. Created on
+ * first use with one thread per hardware thread.
+ */
+inline const std::shared_ptr<Executor>& default_executor() {
+    static auto executor = std::make_shared<Executor>();
+    return executor;
+}
+
+}    // namespace cppflow
+
+
+namespace cppflow {
+
+inline Executor::Executor(std::size_t num_threads, std::size_t max_queue_depth)
+    : max_queue_depth_(max_queue_depth) {
+    if (num_threads == 0) {
+        throw std::runtime_error("An Executor needs at least one thread");
+    }
+    workers_.reserve(num_threads);
+    for (std::size_t i = 0; i < num_threads; ++i) {
+        workers_.emplace_back(&Executor::loop, this);
+    }
+}
+
+inline Executor::~Executor() {
+    {
+        auto lock = std::lock_guard {mutex_};
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+inline bool Executor::try_submit(std::function<void()> task) {
+    {
+        auto lock = std::lock_guard {mutex_};
+        if (stop_ || queue_.size() >= max_queue_depth_) {
+            return false;
+        }
+        queue_.emplace_back(std::move(task));
+    }
+    cv_.notify_one();
+    return true;
+}
+
+template<typename Func>
+inline std::future<std::invoke_result_t<Func>> Executor::async(Func&& func) {
+    // std::function needs a copyable target, so share the packaged task
+    using Result = std::invoke_result_t<Func>;
+    auto task = std::make_shared<std::packaged_task<Result()>>(
+        std::forward<Func>(func));
+    auto future = task->get_future();
+    submit([task] { (*task)(); });
+    return future;
+}
+
+inline std::size_t Executor::queue_depth() const {
+    auto lock = std::lock_guard {mutex_};
+    return queue_.size();
+}
+
+inline void Executor::set_error_handler(ErrorHandler handler) {
+    auto lock = std::lock_guard {mutex_};
+    error_handler_ = std::move(handler);
+}
+
+inline void Executor::loop() {
+    while (true) {
+        auto task = std::function<void()> {};
+        {
+            auto lock = std::unique_lock {mutex_};
+            cv_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        try {
+            task();
+        } catch (...) {
+            auto handler = ErrorHandler {};
+            {
+                auto lock = std::lock_guard {mutex_};
+                handler = error_handler_;
+            }
+            if (handler) {
+                try {
+                    handler(std::current_exception());
+                } catch (...) {
+                }
+            }
+        }
+    }
+}
+
+}    // namespace cppflow
+
+#endif
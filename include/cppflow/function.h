@@ -0,0 +1,325 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_FUNCTION_H__
+#define __CPPFLOW2_FUNCTION_H__
+
+#include "context.h"
+#include "datatype.h"
+#include "ops.h"
+#include "tensor.h"
+
+#include <tensorflow/c/c_api.h>
+#include <tensorflow/c/eager/c_api.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace cppflow {
+
+/**
+ * @class Function
+ * @brief Compiles a callable made of cppflow ops into one TensorFlow
+ * function
+ *
+ * The callable is traced once per dtype and shape signature of its inputs.
+ * The ops it calls are added to a graph instead of being run, the graph is
+ * registered with the eager context as a function, and every call then runs
+ * that function as a single op. Grappler optimises the whole chain, fusing
+ * and parallelising its ops, and the intermediate tensors never come back
+ * to the host.
+ *
+ *     auto normalize = cppflow::function([](const Tensor& x) {
+ *         auto centered = x - reduce_mean(x, {-1}, true);
+ *         return centered * ops::Rsqrt(reduce_mean(centered * centered));
+ *     });
+ *     auto y = normalize(x);
+ *
+ * The callable receives symbolic tensors, which have a dtype and dims but
+ * no values, and returns a Tensor or a std::vector<Tensor>. It only runs
+ * while tracing, so its C++ control flow may depend on dims and dtypes but
+ * not on values. Eager tensors it uses are embedded as constants.
+ */
+template<typename F>
+class Function {
+public:
+    /**
+     * @param f The callable, taking one const Tensor& per input
+     * @param name Prefix of the names of the registered functions
+     */
+    explicit Function(F f, std::string name = "cppflow_function");
+
+    ~Function();
+    Function(const Function&) = delete;
+    Function& operator=(const Function&) = delete;
+
+    /**
+     * Runs the function, tracing it first if no call had the same input
+     * dtypes and shapes
+     * @return The outputs, as returned by the callable
+     */
+    template<typename... Tensors,
+             std::enable_if_t<
+                 (std::is_convertible_v<const Tensors&, const Tensor&> && ...),
+                 bool>
+             = true>
+    auto operator()(const Tensors&... inputs);
+
+    /**
+     * @return The number of signatures traced so far
+     */
+    std::size_t num_traces() const;
+
+private:
+    struct Traced {
+        std::string name;
+        std::unique_ptr<TF_Function, decltype(&TF_DeleteFunction)> function;
+        std::size_t num_outputs;
+        // The context the function was registered with, see
+        // detail::context_generation()
+        std::optional<uint64_t> generation;
+    };
+
+    template<std::size_t N>
+    Traced& lookup(const std::array<const Tensor*, N>& inputs);
+
+    template<std::size_t N>
+    Traced trace(const std::array<const Tensor*, N>& inputs);
+
+private:
+    F f_;
+    std::string name_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Traced> traces_;
+};
+
+/**
+ * Creates a Function, see Function
+ */
+template<typename F>
+Function<F> function(F f, std::string name = "cppflow_function");
+
+}    // namespace cppflow
+
+
+namespace cppflow {
+
+namespace detail {
+
+// What the traced callable receives for each input
+template<typename>
+using TensorArgument = const Tensor&;
+
+// Makes the calling thread trace into a graph for its lifetime
+class TraceScope {
+public:
+    explicit TraceScope(Trace& trace)
+        : previous_(std::exchange(active_trace(), &trace)) {
+    }
+
+    ~TraceScope() {
+        active_trace() = previous_;
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    Trace* previous_;
+};
+
+// Unique across functions, as they share the function library of the
+// context
+inline std::string function_name(const std::string& prefix) {
+    static auto next = std::atomic<uint64_t> {0};
+    return prefix + "_" + std::to_string(next.fetch_add(1));
+}
+
+inline void append_signature(std::string& signature, const Tensor& input) {
+    signature += std::to_string(input.dtype());
+    signature += ':';
+    for (auto dim : input.dims()) {
+        signature += std::to_string(dim);
+        signature += ',';
+    }
+    signature += ';';
+}
+
+// A graph output the function can return. Inputs and eager tensors are
+// passed through an Identity op, as function outputs must be op outputs of
+// the body.
+inline TF_Output function_output(TF_Graph* graph, const Tensor& output) {
+    if (output.is_symbolic() && output.get_graph() == graph
+        && std::string_view {TF_OperationOpType(output.get_output().oper)}
+               != "Placeholder") {
+        return output.get_output();
+    }
+    return ops::Identity(output).get_output();
+}
+
+}    // namespace detail
+
+template<typename F>
+Function<F>::Function(F f, std::string name)
+    : f_(std::move(f)), name_(std::move(name)) {
+}
+
+template<typename F>
+Function<F>::~Function() {
+    auto generation = detail::context_generation().load();
+    for (auto& [signature, traced] : traces_) {
+        if (traced.generation == generation) {
+            // Best effort, errors are ignored
+            TFE_ContextRemoveFunction(context::get_context(),
+                                      traced.name.c_str(),
+                                      context::get_status());
+        }
+    }
+}
+
+template<typename F>
+std::size_t Function<F>::num_traces() const {
+    auto lock = std::lock_guard {mutex_};
+    return traces_.size();
+}
+
+template<typename F>
+template<std::size_t N>
+typename Function<F>::Traced Function<F>::trace(
+    const std::array<const Tensor*, N>& inputs) {
+    auto graph = std::shared_ptr<TF_Graph> {TF_NewGraph(), TF_DeleteGraph};
+    auto trace = detail::Trace {graph};
+
+    // One placeholder per input, with the dims of this signature so that
+    // shape inference and Grappler can rely on them
+    auto placeholders = std::array<TF_Output, N> {};
+    auto arguments = std::vector<Tensor> {};
+    arguments.reserve(N);
+    for (std::size_t i = 0; i < N; ++i) {
+        auto name = "input_" + std::to_string(i);
+        auto dims = inputs[i]->dims();
+        auto* description
+            = TF_NewOperation(graph.get(), "Placeholder", name.c_str());
+        TF_SetAttrType(description, "dtype", inputs[i]->dtype());
+        TF_SetAttrShape(description, "shape", dims.data(),
+                        static_cast<int>(dims.rank()));
+        placeholders[i] = {TF_FinishOperation(description,
+                                              context::get_status()),
+                           0};
+        status_check(context::get_status());
+        arguments.emplace_back(graph, placeholders[i]);
+    }
+
+    auto outputs = std::vector<TF_Output> {};
+    {
+        auto scope = detail::TraceScope {trace};
+        auto result = [&]<std::size_t... I>(std::index_sequence<I...>) {
+            return std::invoke(f_, std::as_const(arguments[I])...);
+        }(std::make_index_sequence<N> {});
+
+        if constexpr (std::is_same_v<decltype(result), Tensor>) {
+            outputs.push_back(detail::function_output(graph.get(), result));
+        } else {
+            static_assert(std::is_same_v<decltype(result), std::vector<Tensor>>,
+                          "A traced function must return a Tensor or a "
+                          "std::vector<Tensor>");
+            for (const auto& output : result) {
+                outputs.push_back(detail::function_output(graph.get(), output));
+            }
+        }
+    }
+
+    auto traced = Traced {detail::function_name(name_),
+                          {nullptr, TF_DeleteFunction},
+                          outputs.size(),
+                          std::nullopt};
+    traced.function.reset(TF_GraphToFunction(
+        graph.get(), traced.name.c_str(), 0, -1, nullptr,
+        static_cast<int>(N), placeholders.data(),
+        static_cast<int>(outputs.size()), outputs.data(), nullptr, nullptr,
+        nullptr, context::get_status()));
+    status_check(context::get_status());
+    return traced;
+}
+
+template<typename F>
+template<std::size_t N>
+typename Function<F>::Traced& Function<F>::lookup(
+    const std::array<const Tensor*, N>& inputs) {
+    auto signature = std::string {};
+    for (const auto* input : inputs) {
+        detail::append_signature(signature, *input);
+    }
+
+    auto lock = std::lock_guard {mutex_};
+    auto found = traces_.find(signature);
+    if (found == traces_.end()) {
+        found = traces_.emplace(std::move(signature), trace(inputs)).first;
+    }
+
+    // Registered again after the context was replaced
+    auto& traced = found->second;
+    auto generation = detail::context_generation().load();
+    if (traced.generation != generation) {
+        TFE_ContextAddFunction(context::get_context(), traced.function.get(),
+                               context::get_status());
+        status_check(context::get_status());
+        traced.generation = generation;
+    }
+    return traced;
+}
+
+template<typename F>
+template<typename... Tensors,
+         std::enable_if_t<
+             (std::is_convertible_v<const Tensors&, const Tensor&> && ...),
+             bool>>
+auto Function<F>::operator()(const Tensors&... inputs) {
+    using Result = std::invoke_result_t<F&, detail::TensorArgument<Tensors>...>;
+
+    auto arguments = std::array<const Tensor*, sizeof...(Tensors)> {
+        &static_cast<const Tensor&>(inputs)...};
+    auto& traced = lookup(arguments);
+
+    // Called from another function being traced, which needs the function
+    // in its own graph
+    if (auto* trace = detail::active_trace()) {
+        TF_GraphCopyFunction(trace->graph.get(), traced.function.get(),
+                             nullptr, context::get_status());
+        status_check(context::get_status());
+    }
+
+    auto op = detail::OpBuilder {traced.name.c_str()};
+    for (const auto* input : arguments) {
+        op.add_input(*input);
+    }
+    if constexpr (std::is_same_v<Result, Tensor>) {
+        return op.execute();
+    } else {
+        return op.execute(static_cast<int>(traced.num_outputs));
+    }
+}
+
+template<typename F>
+Function<F> function(F f, std::string name) {
+    return Function<F> {std::move(f), std::move(name)};
+}
+
+}    // namespace cppflow
+
+#endif
@@ -0,0 +1,695 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_GRAPH_DEF_H__
+#define __CPPFLOW2_GRAPH_DEF_H__
+
+#include "npy.h"
+#include "proto.h"
+#include "tensor.h"
+
+#include <tensorflow/c/c_api.h>
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+namespace cppflow {
+
+/**
+ * Fetches the values of variables, given as node names
+ */
+using TensorFetcher
+    = std::function<std::vector<Tensor>(const std::vector<std::string>&)>;
+
+/**
+ * A graph whose variables were turned into inputs, see freeze_graph_def()
+ */
+struct FrozenGraph {
+    // Serialized tensorflow.GraphDef, holding no variable values
+    std::string graph_def;
+    // The value of every frozen variable, keyed by its Placeholder name
+    std::map<std::string, Tensor> weights;
+
+    /**
+     * Writes the GraphDef, and the weights as an .npz archive laid out for
+     * zero-copy loading, see Model::from_graph_def()
+     * @throw std::runtime_error if a file cannot be written, or for string
+     * and bfloat16 variables, which .npz cannot hold
+     */
+    void save(const std::filesystem::path& graph_def_file,
+              const std::filesystem::path& weights_file) const;
+};
+
+/**
+ * Freezes the variables of a serialized tensorflow.GraphDef and prunes
+ * everything the outputs do not depend on, such as the restore and
+ * initialisation subgraphs. Each variable becomes a Placeholder node of the
+ * same name, dtype and shape, whose value is returned separately so that
+ * the GraphDef stays small. Reads of resource variables are rewritten to
+ * use the placeholder, also inside the functions they are passed to, as
+ * in TF2 SavedModels: ReadVariableOp becomes Identity and ResourceGather
+ * becomes Gather.
+ *
+ * @param graph_def The GraphDef, e.g. from TF_GraphToGraphDef
+ * @param outputs Names of the nodes or tensors to keep
+ * @param fetch Evaluates the variables, usually through the session
+ * @return The frozen graph and the values of its placeholders
+ * @throw std::runtime_error if a resource variable is used by another op,
+ * e.g. to be updated
+ */
+inline FrozenGraph freeze_graph_def(std::string_view graph_def,
+                                    const std::vector<std::string>& outputs,
+                                    const TensorFetcher& fetch);
+
+}    // namespace cppflow
+
+
+namespace cppflow {
+
+namespace detail {
+
+struct NodeDefInfo {
+    std::string name;
+    std::string op;
+    std::vector<std::string> inputs;
+    // Function called by the node, from its "f" attribute
+    std::string function;
+    std::string_view bytes;
+};
+
+struct FunctionDefInfo {
+    std::string name;
+    std::vector<std::string> args;
+    std::vector<NodeDefInfo> nodes;
+    std::string_view bytes;
+};
+
+// The dtypes fed instead of resources, by input or argument index
+using FrozenArgs = std::map<std::size_t, TF_DataType>;
+
+// The dtypes fed instead of resources, by node or argument name
+using FrozenNames = std::map<std::string_view, TF_DataType>;
+
+// "^node" and "node:1" both refer to "node"
+inline std::string_view input_node_name(std::string_view input) {
+    if (!input.empty() && input.front() == '^') {
+        input.remove_prefix(1);
+    }
+    return input.substr(0, input.find(':'));
+}
+
+// Writes a field as it was read
+inline void copy_field(ProtoWriter& writer, const ProtoReader& reader) {
+    switch (reader.type()) {
+        case ProtoWriter::kVarint:
+            writer.write_int(reader.field(), reader.int64());
+            break;
+        case ProtoWriter::kFixed64:
+            writer.write_double(reader.field(), reader.fixed_double());
+            break;
+        case ProtoWriter::kFixed32:
+            writer.write_float(reader.field(), reader.fixed_float());
+            break;
+        default:
+            writer.write_bytes(reader.field(), reader.bytes());
+            break;
+    }
+}
+
+// Field numbers from tensorflow/core/framework/node_def.proto,
+// attr_value.proto, function.proto, op_def.proto and graph.proto
+
+inline ProtoWriter attr_entry(std::string_view key, const ProtoWriter& value) {
+    auto entry = ProtoWriter {};
+    entry.write_bytes(1, key).write_message(2, value);
+    return entry;
+}
+
+inline ProtoWriter type_attr(TF_DataType dtype) {
+    auto value = ProtoWriter {};
+    value.write_int(6, dtype);
+    return value;
+}
+
+inline NodeDefInfo parse_node_def(std::string_view bytes) {
+    auto node = NodeDefInfo {};
+    node.bytes = bytes;
+    auto fields = ProtoReader {bytes};
+    while (fields.next()) {
+        switch (fields.field()) {
+            case 1:
+                node.name = fields.bytes();
+                break;
+            case 2:
+                node.op = fields.bytes();
+                break;
+            case 3:
+                node.inputs.emplace_back(fields.bytes());
+                break;
+            case 5: {
+                auto entry = ProtoReader {fields.bytes()};
+                auto key = std::string_view {};
+                auto value = std::string_view {};
+                while (entry.next()) {
+                    if (entry.field() == 1) {
+                        key = entry.bytes();
+                    } else if (entry.field() == 2) {
+                        value = entry.bytes();
+                    }
+                }
+                if (key != "f") {
+                    break;
+                }
+                auto attr = ProtoReader {value};
+                while (attr.next()) {
+                    if (attr.field() != 10) {
+                        continue;
+                    }
+                    auto func = ProtoReader {attr.bytes()};
+                    while (func.next()) {
+                        if (func.field() == 1) {
+                            node.function = func.bytes();
+                        }
+                    }
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    return node;
+}
+
+inline FunctionDefInfo parse_function_def(std::string_view bytes) {
+    auto function = FunctionDefInfo {};
+    function.bytes = bytes;
+    auto fields = ProtoReader {bytes};
+    while (fields.next()) {
+        if (fields.field() == 3) {
+            function.nodes.emplace_back(parse_node_def(fields.bytes()));
+        } else if (fields.field() == 1) {
+            auto signature = ProtoReader {fields.bytes()};
+            while (signature.next()) {
+                if (signature.field() == 1) {
+                    function.name = signature.bytes();
+                } else if (signature.field() == 2) {
+                    auto arg = ProtoReader {signature.bytes()};
+                    auto name = std::string {};
+                    while (arg.next()) {
+                        if (arg.field() == 1) {
+                            name = arg.bytes();
+                        }
+                    }
+                    function.args.emplace_back(std::move(name));
+                }
+            }
+        }
+    }
+    return function;
+}
+
+inline bool is_call_op(std::string_view op) {
+    return op == "PartitionedCall" || op == "StatefulPartitionedCall";
+}
+
+// The data inputs of `node` that are frozen resources
+inline FrozenArgs frozen_inputs(const NodeDefInfo& node,
+                                const FrozenNames& frozen) {
+    auto inputs = FrozenArgs {};
+    for (std::size_t i = 0; i < node.inputs.size(); ++i) {
+        if (!node.inputs[i].empty() && node.inputs[i].front() == '^') {
+            continue;
+        }
+        auto resource = frozen.find(input_node_name(node.inputs[i]));
+        if (resource != frozen.end()) {
+            inputs.emplace(i, resource->second);
+        }
+    }
+    return inputs;
+}
+
+// Inside functions, an Identity replacing a ReadVariableOp names its output
+// "output" instead of "value"
+inline std::string rename_input(std::string_view input,
+                                const std::set<std::string>& renamed) {
+    auto first = input.find(':');
+    if (first == std::string_view::npos
+        || !renamed.count(std::string {input.substr(0, first)})) {
+        return std::string {input};
+    }
+    auto second = input.find(':', first + 1);
+    if (input.substr(first + 1, second - first - 1) != "value") {
+        return std::string {input};
+    }
+    return std::string {input.substr(0, first)} + ":output"
+           + std::string {input.substr(second)};
+}
+
+// Tin with the frozen inputs typed as their values
+inline ProtoWriter frozen_input_types(std::string_view attr,
+                                      const FrozenArgs& frozen) {
+    auto types = std::vector<int64_t> {};
+    auto value = ProtoReader {attr};
+    while (value.next()) {
+        if (value.field() != 1) {
+            continue;
+        }
+        auto list = ProtoReader {value.bytes()};
+        while (list.next()) {
+            if (list.field() != 6) {
+                continue;
+            }
+            if (list.type() == ProtoWriter::kVarint) {
+                types.emplace_back(list.int64());
+                continue;
+            }
+            // Packed, as proto3 writes repeated enums
+            auto packed = list.bytes();
+            auto pos = std::size_t {0};
+            while (pos < packed.size()) {
+                types.emplace_back(static_cast<int64_t>(
+                    ProtoReader::read_varint(packed, pos)));
+            }
+        }
+    }
+
+    auto list = ProtoWriter {};
+    for (std::size_t i = 0; i < types.size(); ++i) {
+        auto input = frozen.find(i);
+        list.write_int(6, input == frozen.end()
+                              ? types[i]
+                              : static_cast<int64_t>(input->second));
+    }
+    auto result = ProtoWriter {};
+    result.write_message(1, list);
+    return result;
+}
+
+// Rewrites a node so that the inputs in `frozen`, which were resource
+// variables, are read as values
+inline std::string rewrite_node_def(const NodeDefInfo& node,
+                                    const FrozenArgs& frozen,
+                                    const std::set<std::string>& renamed) {
+    if (frozen.empty() && renamed.empty()) {
+        return std::string {node.bytes};
+    }
+
+    auto op = node.op;
+    auto dropped = std::set<std::string_view> {};
+    auto added = std::vector<ProtoWriter> {};
+    if (!frozen.empty()) {
+        auto first_only = frozen.size() == 1 && frozen.begin()->first == 0;
+        auto dtype = frozen.begin()->second;
+        if (node.op == "ReadVariableOp" && first_only) {
+            op = "Identity";
+            dropped = {"dtype"};
+            added.emplace_back(attr_entry("T", type_attr(dtype)));
+        } else if (node.op == "ResourceGather" && first_only) {
+            op = "Gather";
+            dropped = {"dtype", "batch_dims"};
+            added.emplace_back(attr_entry("Tparams", type_attr(dtype)));
+        } else if (!is_call_op(node.op)) {
+            throw std::runtime_error("Node \"" + node.name + "\" ("
+                                     + node.op
+                                     + ") uses a variable in a way that "
+                                       "cannot be frozen");
+        }
+    }
+
+    auto writer = ProtoWriter {};
+    auto fields = ProtoReader {node.bytes};
+    while (fields.next()) {
+        switch (fields.field()) {
+            case 2:
+                writer.write_bytes(2, op);
+                break;
+            case 3:
+                writer.write_bytes(3, rename_input(fields.bytes(), renamed));
+                break;
+            case 5: {
+                auto entry = ProtoReader {fields.bytes()};
+                auto key = std::string_view {};
+                auto value = std::string_view {};
+                while (entry.next()) {
+                    if (entry.field() == 1) {
+                        key = entry.bytes();
+                    } else if (entry.field() == 2) {
+                        value = entry.bytes();
+                    }
+                }
+                if (key == "batch_dims" && dropped.count(key)) {
+                    auto attr = ProtoReader {value};
+                    while (attr.next()) {
+                        if (attr.field() == 3 && attr.int64() != 0) {
+                            throw std::runtime_error(
+                                "Node \"" + node.name
+                                + "\" gathers from a variable with "
+                                  "batch_dims and cannot be frozen");
+                        }
+                    }
+                }
+                if (dropped.count(key)) {
+                    break;
+                }
+                if (key == "Tin" && !frozen.empty()) {
+                    writer.write_message(
+                        5, attr_entry(key, frozen_input_types(value, frozen)));
+                    break;
+                }
+                writer.write_bytes(5, fields.bytes());
+                break;
+            }
+            default:
+                copy_field(writer, fields);
+                break;
+        }
+    }
+    for (const auto& attr : added) {
+        writer.write_message(5, attr);
+    }
+    return writer.str();
+}
+
+inline std::string placeholder_node_def(const std::string& name,
+                                        const Tensor& value) {
+    auto tensor = value.get_tensor();
+    auto shape = ProtoWriter {};
+    for (int i = 0; i < TF_NumDims(tensor.get()); ++i) {
+        auto dim = ProtoWriter {};
+        dim.write_int(1, TF_Dim(tensor.get(), i));
+        shape.write_message(2, dim);
+    }
+
+    auto writer = ProtoWriter {};
+    writer.write_bytes(1, name);
+    writer.write_bytes(2, "Placeholder");
+    writer.write_message(
+        5, attr_entry("dtype", type_attr(TF_TensorType(tensor.get()))));
+    writer.write_message(
+        5, attr_entry("shape", ProtoWriter {}.write_message(7, shape)));
+    return writer.str();
+}
+
+// Rewrites a function whose resource arguments in `args` are now values
+inline std::string rewrite_function_def(const FunctionDefInfo& function,
+                                        const FrozenArgs& args) {
+    auto frozen = FrozenNames {};
+    for (const auto& [index, dtype] : args) {
+        frozen.emplace(function.args[index], dtype);
+    }
+
+    auto renamed = std::set<std::string> {};
+    for (const auto& node : function.nodes) {
+        if (node.op == "ReadVariableOp"
+            && !frozen_inputs(node, frozen).empty()) {
+            renamed.insert(node.name);
+        }
+    }
+
+    auto writer = ProtoWriter {};
+    auto node = function.nodes.begin();
+    auto fields = ProtoReader {function.bytes};
+    while (fields.next()) {
+        switch (fields.field()) {
+            case 1: {
+                // The signature, with the frozen arguments retyped
+                auto signature = ProtoWriter {};
+                auto index = std::size_t {0};
+                auto reader = ProtoReader {fields.bytes()};
+                while (reader.next()) {
+                    if (reader.field() != 2 || !args.count(index++)) {
+                        copy_field(signature, reader);
+                        continue;
+                    }
+                    auto arg = ProtoWriter {};
+                    auto arg_fields = ProtoReader {reader.bytes()};
+                    while (arg_fields.next()) {
+                        // type and handle_data describe the resource
+                        auto field = arg_fields.field();
+                        if (field != 3 && field != 7) {
+                            copy_field(arg, arg_fields);
+                        }
+                    }
+                    arg.write_int(3, args.at(index - 1));
+                    signature.write_message(2, arg);
+                }
+                writer.write_message(1, signature);
+                break;
+            }
+            case 3:
+                writer.write_bytes(3, rewrite_node_def(
+                                          *node, frozen_inputs(*node, frozen),
+                                          renamed));
+                ++node;
+                break;
+            case 4: {
+                auto entry = ProtoReader {fields.bytes()};
+                auto ret = ProtoWriter {};
+                while (entry.next()) {
+                    if (entry.field() != 2) {
+                        copy_field(ret, entry);
+                        continue;
+                    }
+                    if (frozen.count(input_node_name(entry.bytes()))) {
+                        throw std::runtime_error(
+                            "Function \"" + function.name
+                            + "\" returns a variable, which cannot be frozen");
+                    }
+                    ret.write_bytes(2, rename_input(entry.bytes(), renamed));
+                }
+                writer.write_message(4, ret);
+                break;
+            }
+            case 8: {
+                // resource_arg_unique_id, only meaningful for resources
+                auto entry = ProtoReader {fields.bytes()};
+                auto keep = true;
+                while (entry.next()) {
+                    if (entry.field() == 1 && args.count(entry.varint())) {
+                        keep = false;
+                    }
+                }
+                if (keep) {
+                    writer.write_bytes(8, fields.bytes());
+                }
+                break;
+            }
+            default:
+                copy_field(writer, fields);
+                break;
+        }
+    }
+    return writer.str();
+}
+
+}    // namespace detail
+
+inline void FrozenGraph::save(const std::filesystem::path& graph_def_file,
+                              const std::filesystem::path& weights_file) const {
+    auto file = std::ofstream {graph_def_file, std::ios::binary};
+    file.write(graph_def.data(),
+               static_cast<std::streamsize>(graph_def.size()));
+    if (!file) {
+        throw std::runtime_error("Could not write " + graph_def_file.string());
+    }
+    write_npz(weights_file, weights);
+}
+
+inline FrozenGraph freeze_graph_def(std::string_view graph_def,
+                                    const std::vector<std::string>& outputs,
+                                    const TensorFetcher& fetch) {
+    auto nodes = std::vector<detail::NodeDefInfo> {};
+    auto functions = std::vector<detail::FunctionDefInfo> {};
+    auto library = std::string_view {};
+    auto other_fields = ProtoWriter {};
+    auto reader = ProtoReader {graph_def};
+    while (reader.next()) {
+        if (reader.field() == 1) {
+            nodes.emplace_back(detail::parse_node_def(reader.bytes()));
+        } else if (reader.field() == 2) {
+            library = reader.bytes();
+            auto fields = ProtoReader {library};
+            while (fields.next()) {
+                if (fields.field() == 1) {
+                    functions.emplace_back(
+                        detail::parse_function_def(fields.bytes()));
+                }
+            }
+        } else {
+            // versions are kept as they are
+            detail::copy_field(other_fields, reader);
+        }
+    }
+
+    auto by_name = std::map<std::string_view, std::size_t> {};
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        by_name.emplace(nodes[i].name, i);
+    }
+
+    // Mark the nodes the outputs depend on
+    auto kept = std::vector<bool>(nodes.size());
+    auto stack = std::vector<std::size_t> {};
+    for (const auto& output : outputs) {
+        auto node = by_name.find(detail::input_node_name(output));
+        if (node == by_name.end()) {
+            throw std::runtime_error("No operation named \"" + output
+                                     + "\" exists");
+        }
+        stack.emplace_back(node->second);
+    }
+    while (!stack.empty()) {
+        auto index = stack.back();
+        stack.pop_back();
+        if (kept[index]) {
+            continue;
+        }
+        kept[index] = true;
+        for (const auto& input : nodes[index].inputs) {
+            auto node = by_name.find(detail::input_node_name(input));
+            if (node == by_name.end()) {
+                throw std::runtime_error("Node \"" + nodes[index].name
+                                         + "\" has unknown input \"" + input
+                                         + "\"");
+            }
+            stack.emplace_back(node->second);
+        }
+    }
+
+    auto variables = std::vector<std::size_t> {};
+    auto names = std::vector<std::string> {};
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        const auto& op = nodes[i].op;
+        if (kept[i]
+            && (op == "VarHandleOp" || op == "VariableV2"
+                || op == "Variable")) {
+            variables.emplace_back(i);
+            names.emplace_back(nodes[i].name);
+        }
+    }
+    auto values = names.empty() ? std::vector<Tensor> {} : fetch(names);
+    if (values.size() != names.size()) {
+        throw std::runtime_error("Fetching the variables returned "
+                                 + std::to_string(values.size())
+                                 + " values for " + std::to_string(names.size())
+                                 + " variables");
+    }
+
+    // Reference variables are read by Identity and need no rewriting, the
+    // users of resource variables are rewritten to take the values
+    auto frozen = FrozenGraph {};
+    auto resources = detail::FrozenNames {};
+    for (std::size_t i = 0; i < variables.size(); ++i) {
+        const auto& node = nodes[variables[i]];
+        if (node.op == "VarHandleOp") {
+            resources.emplace(node.name,
+                              TF_TensorType(values[i].get_tensor().get()));
+        }
+        frozen.weights.emplace(node.name, values[i]);
+    }
+    // Follow the resources into the functions they are passed to
+    auto by_function = std::map<std::string_view, std::size_t> {};
+    for (std::size_t i = 0; i < functions.size(); ++i) {
+        by_function.emplace(functions[i].name, i);
+    }
+    auto function_args = std::map<std::string, detail::FrozenArgs> {};
+    auto pending = std::vector<std::pair<std::string, detail::FrozenArgs>> {};
+    auto pass_to_callee = [&](const detail::NodeDefInfo& node,
+                              const detail::FrozenArgs& inputs) {
+        if (!inputs.empty() && detail::is_call_op(node.op)) {
+            pending.emplace_back(node.function, inputs);
+        }
+    };
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        if (kept[i]) {
+            pass_to_callee(nodes[i],
+                           detail::frozen_inputs(nodes[i], resources));
+        }
+    }
+    while (!pending.empty()) {
+        auto [name, inputs] = std::move(pending.back());
+        pending.pop_back();
+        auto function = by_function.find(name);
+        if (function == by_function.end()) {
+            throw std::runtime_error("No function named \"" + name
+                                     + "\" exists");
+        }
+
+        auto& args = function_args[name];
+        auto added = detail::FrozenArgs {};
+        for (const auto& [index, dtype] : inputs) {
+            if (args.emplace(index, dtype).second) {
+                added.emplace(index, dtype);
+            }
+        }
+        const auto& info = functions[function->second];
+        auto arg_names = detail::FrozenNames {};
+        for (const auto& [index, dtype] : added) {
+            if (index >= info.args.size()) {
+                throw std::runtime_error("Function \"" + name
+                                         + "\" has no argument "
+                                         + std::to_string(index));
+            }
+            arg_names.emplace(info.args[index], dtype);
+        }
+        for (const auto& node : info.nodes) {
+            pass_to_callee(node, detail::frozen_inputs(node, arg_names));
+        }
+    }
+
+    auto writer = ProtoWriter {};
+    for (std::size_t i = 0; i < nodes.size(); ++i) {
+        if (!kept[i]) {
+            continue;
+        }
+        if (frozen.weights.count(nodes[i].name)) {
+            writer.write_bytes(1,
+                               detail::placeholder_node_def(
+                                   nodes[i].name,
+                                   frozen.weights.at(nodes[i].name)));
+        } else {
+            writer.write_bytes(
+                1, detail::rewrite_node_def(
+                       nodes[i], detail::frozen_inputs(nodes[i], resources),
+                       {}));
+        }
+    }
+
+    if (!library.empty()) {
+        auto rewritten = ProtoWriter {};
+        auto fields = ProtoReader {library};
+        auto function = functions.begin();
+        while (fields.next()) {
+            if (fields.field() != 1) {
+                detail::copy_field(rewritten, fields);
+                continue;
+            }
+            auto args = function_args.find(function->name);
+            if (args == function_args.end()) {
+                rewritten.write_bytes(1, fields.bytes());
+            } else {
+                rewritten.write_bytes(
+                    1, detail::rewrite_function_def(*function, args->second));
+            }
+            ++function;
+        }
+        writer.write_message(2, rewritten);
+    }
+
+    frozen.graph_def = writer.str() + other_fields.str();
+    return frozen;
+}
+
+}    // namespace cppflow
+
+#endif
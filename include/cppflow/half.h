@@ -0,0 +1,297 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_HALF_H__
+#define __CPPFLOW2_HALF_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+#if (defined(__GNUC__) || defined(__clang__)) \
+    && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define CPPFLOW2_X86_DISPATCH 1
+#endif
+
+
+namespace cppflow {
+
+/**
+ * IEEE 754 half precision value, the element type of TF_HALF tensors
+ */
+struct float16 {
+    uint16_t bits {0};
+
+    float16() = default;
+    explicit float16(float value);
+    explicit operator float() const;
+
+    static float16 from_bits(uint16_t bits) {
+        auto value = float16 {};
+        value.bits = bits;
+        return value;
+    }
+
+    friend bool operator==(float16 lhs, float16 rhs) {
+        return lhs.bits == rhs.bits;
+    }
+};
+
+/**
+ * Brain floating point value, the element type of TF_BFLOAT16 tensors
+ */
+struct bfloat16 {
+    uint16_t bits {0};
+
+    bfloat16() = default;
+    explicit bfloat16(float value);
+    explicit operator float() const;
+
+    static bfloat16 from_bits(uint16_t bits) {
+        auto value = bfloat16 {};
+        value.bits = bits;
+        return value;
+    }
+
+    friend bool operator==(bfloat16 lhs, bfloat16 rhs) {
+        return lhs.bits == rhs.bits;
+    }
+};
+
+static_assert(sizeof(float16) == 2 && sizeof(bfloat16) == 2);
+
+/**
+ * Converts between float and the 16-bit formats, rounding to nearest even.
+ * Uses F16C for float16 and AVX-512 BF16 for float to bfloat16 when the CPU
+ * has them, a scalar loop otherwise. Both give the same bits, denormals
+ * included. NaNs come out quiet and keep as much of their payload as fits.
+ * @throw std::invalid_argument if the sizes differ
+ */
+inline void convert(std::span<const float> src, std::span<float16> dst);
+inline void convert(std::span<const float16> src, std::span<float> dst);
+inline void convert(std::span<const float> src, std::span<bfloat16> dst);
+inline void convert(std::span<const bfloat16> src, std::span<float> dst);
+
+}    // namespace cppflow
+
+
+namespace cppflow {
+
+namespace detail {
+
+inline uint32_t float_bits(float value) {
+    auto bits = uint32_t {};
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+inline float bits_float(uint32_t bits) {
+    auto value = float {};
+    std::memcpy(&value, &bits, sizeof(bits));
+    return value;
+}
+
+inline uint16_t float_to_half(float value) {
+    auto bits = float_bits(value);
+    auto sign = static_cast<uint16_t>((bits >> 16) & 0x8000u);
+    auto magnitude = bits & 0x7fffffffu;
+
+    // NaN becomes a quiet NaN keeping the top of its payload, as with F16C.
+    // Too large values become infinity
+    if (magnitude > 0x7f800000u) {
+        auto payload = static_cast<uint16_t>((magnitude >> 13) & 0x3ffu);
+        return sign | 0x7e00u | payload;
+    }
+    if (magnitude >= 0x47800000u) {
+        return sign | 0x7c00u;
+    }
+
+    // Subnormal results, including zero
+    if (magnitude < 0x38800000u) {
+        auto shifted = bits_float(magnitude) + 0.5f;
+        return sign | static_cast<uint16_t>(float_bits(shifted) - 0x3f000000u);
+    }
+
+    // Rebias the exponent and round the dropped 13 bits to nearest even
+    auto odd = (magnitude >> 13) & 1u;
+    magnitude += 0xc8000fffu + odd;
+    return sign | static_cast<uint16_t>(magnitude >> 13);
+}
+
+inline float half_to_float(uint16_t value) {
+    auto sign = static_cast<uint32_t>(value & 0x8000u) << 16;
+    auto exponent = (value >> 10) & 0x1fu;
+    auto mantissa = static_cast<uint32_t>(value & 0x3ffu);
+
+    if (exponent == 0x1f) {
+        // Signalling NaNs are quieted, as with F16C
+        if (mantissa != 0) {
+            mantissa |= 0x200u;
+        }
+        return bits_float(sign | 0x7f800000u | (mantissa << 13));
+    }
+    if (exponent == 0) {
+        // Zero or subnormal, exactly representable as float
+        auto magnitude = static_cast<float>(mantissa) * 5.9604644775390625e-8f;
+        return bits_float(sign | float_bits(magnitude));
+    }
+    return bits_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+inline uint16_t float_to_bfloat16(float value) {
+    auto bits = float_bits(value);
+    if ((bits & 0x7fffffffu) > 0x7f800000u) {
+        return static_cast<uint16_t>((bits >> 16) | 0x40u);
+    }
+    bits += 0x7fffu + ((bits >> 16) & 1u);
+    return static_cast<uint16_t>(bits >> 16);
+}
+
+inline float bfloat16_to_float(uint16_t value) {
+    return bits_float(static_cast<uint32_t>(value) << 16);
+}
+
+inline void check_convert_sizes(std::size_t src, std::size_t dst) {
+    if (src != dst) {
+        throw std::invalid_argument("Cannot convert " + std::to_string(src)
+                                    + " values into " + std::to_string(dst));
+    }
+}
+
+#if defined(CPPFLOW2_X86_DISPATCH)
+
+__attribute__((target("avx,f16c"))) inline std::size_t float_to_half_f16c(
+    const float* src, uint16_t* dst, std::size_t count) {
+    auto i = std::size_t {0};
+    for (; i + 8 <= count; i += 8) {
+        auto values = _mm256_loadu_ps(src + i);
+        auto halves = _mm256_cvtps_ph(values, _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), halves);
+    }
+    return i;
+}
+
+__attribute__((target("avx,f16c"))) inline std::size_t half_to_float_f16c(
+    const uint16_t* src, float* dst, std::size_t count) {
+    auto i = std::size_t {0};
+    for (; i + 8 <= count; i += 8) {
+        auto halves
+            = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        _mm256_storeu_ps(dst + i, _mm256_cvtph_ps(halves));
+    }
+    return i;
+}
+
+// VCVTNEPS2BF16 flushes denormal inputs to zero, those lanes are redone
+// with the scalar conversion so both paths give the same bits
+__attribute__((target("avx512f,avx512bf16"))) inline std::size_t
+float_to_bfloat16_avx512(const float* src, uint16_t* dst, std::size_t count) {
+    const auto exponent = _mm512_set1_epi32(0x7f800000);
+    const auto mantissa = _mm512_set1_epi32(0x007fffff);
+    auto i = std::size_t {0};
+    for (; i + 16 <= count; i += 16) {
+        auto values = _mm512_loadu_ps(src + i);
+        auto converted = _mm512_cvtneps_pbh(values);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i),
+                            (__m256i)converted);
+
+        auto bits = _mm512_castps_si512(values);
+        auto denormals = _mm512_mask_test_epi32_mask(
+            _mm512_testn_epi32_mask(bits, exponent), bits, mantissa);
+        for (; denormals != 0; denormals &= denormals - 1) {
+            auto lane = static_cast<std::size_t>(__builtin_ctz(denormals));
+            dst[i + lane] = float_to_bfloat16(src[i + lane]);
+        }
+    }
+    return i;
+}
+
+inline bool has_f16c() {
+    static const auto supported = __builtin_cpu_supports("f16c") != 0;
+    return supported;
+}
+
+inline bool has_avx512_bf16() {
+    static const auto supported
+        = __builtin_cpu_supports("avx512bf16") != 0;
+    return supported;
+}
+
+#endif
+
+}    // namespace detail
+
+inline float16::float16(float value) : bits(detail::float_to_half(value)) {
+}
+
+inline float16::operator float() const {
+    return detail::half_to_float(bits);
+}
+
+inline bfloat16::bfloat16(float value)
+    : bits(detail::float_to_bfloat16(value)) {
+}
+
+inline bfloat16::operator float() const {
+    return detail::bfloat16_to_float(bits);
+}
+
+inline void convert(std::span<const float> src, std::span<float16> dst) {
+    detail::check_convert_sizes(src.size(), dst.size());
+    auto* out = reinterpret_cast<uint16_t*>(dst.data());
+    auto i = std::size_t {0};
+#if defined(CPPFLOW2_X86_DISPATCH)
+    if (detail::has_f16c()) {
+        i = detail::float_to_half_f16c(src.data(), out, src.size());
+    }
+#endif
+    for (; i < src.size(); ++i) {
+        out[i] = detail::float_to_half(src[i]);
+    }
+}
+
+inline void convert(std::span<const float16> src, std::span<float> dst) {
+    detail::check_convert_sizes(src.size(), dst.size());
+    const auto* in = reinterpret_cast<const uint16_t*>(src.data());
+    auto i = std::size_t {0};
+#if defined(CPPFLOW2_X86_DISPATCH)
+    if (detail::has_f16c()) {
+        i = detail::half_to_float_f16c(in, dst.data(), src.size());
+    }
+#endif
+    for (; i < src.size(); ++i) {
+        dst[i] = detail::half_to_float(in[i]);
+    }
+}
+
+inline void convert(std::span<const float> src, std::span<bfloat16> dst) {
+    detail::check_convert_sizes(src.size(), dst.size());
+    auto* out = reinterpret_cast<uint16_t*>(dst.data());
+    auto i = std::size_t {0};
+#if defined(CPPFLOW2_X86_DISPATCH)
+    if (detail::has_avx512_bf16()) {
+        i = detail::float_to_bfloat16_avx512(src.data(), out, src.size());
+    }
+#endif
+    for (; i < src.size(); ++i) {
+        out[i] = detail::float_to_bfloat16(src[i]);
+    }
+}
+
+inline void convert(std::span<const bfloat16> src, std::span<float> dst) {
+    detail::check_convert_sizes(src.size(), dst.size());
+    // A plain shift, which compilers vectorise on their own
+    const auto* in = reinterpret_cast<const uint16_t*>(src.data());
+    for (std::size_t i = 0; i < src.size(); ++i) {
+        dst[i] = detail::bfloat16_to_float(in[i]);
+    }
+}
+
+}    // namespace cppflow
+
+#endif
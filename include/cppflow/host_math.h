@@ -0,0 +1,553 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_HOST_MATH_H__
+#define __CPPFLOW2_HOST_MATH_H__
+
+#include "datatype.h"
+#include "tensor.h"
+
+#include <tensorflow/c/tf_tensor.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+
+namespace cppflow {
+
+/**
+ * Controls the host fast path of the arithmetic operators and reductions
+ * in ops.h. Small float, double, int32 and int64 tensors in host memory are
+ * computed directly instead of through an eager TensorFlow op, which costs
+ * microseconds of dispatch even for scalars. Everything else goes to the
+ * TensorFlow kernels, as do all ops on an async context, where reading the
+ * inputs would wait for the ops producing them.
+ */
+struct HostMathOptions {
+    bool enabled {true};
+    // Largest result, or input of a reduction, computed on the fast path
+    std::size_t max_elements {4096};
+};
+
+/**
+ * Changes the fast path options for all threads, e.g. disabling it to
+ * cross-check results against the TensorFlow kernels. Elementwise results
+ * are identical; float reductions may differ in the last bits since the
+ * summation order differs.
+ */
+inline void set_host_math_options(const HostMathOptions& options);
+
+inline HostMathOptions host_math_options();
+
+}    // namespace cppflow
+
+
+namespace cppflow {
+
+namespace detail {
+
+enum class HostBinaryOp { kAdd, kSub, kMul, kDiv };
+enum class HostReduceOp { kSum, kMean, kMax, kMin };
+
+struct HostMathState {
+    std::atomic<bool> enabled {true};
+    std::atomic<std::size_t> max_elements {4096};
+};
+
+inline HostMathState& host_math_state() {
+    static auto state = HostMathState {};
+    return state;
+}
+
+// Max rank handled on the fast path, larger ranks go to TensorFlow
+inline constexpr std::size_t kHostMaxRank = 8;
+
+inline bool host_math_applies(const Tensor& tensor, std::size_t elements) {
+    auto& state = host_math_state();
+    if (!state.enabled.load(std::memory_order_relaxed)
+        || elements > state.max_elements.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    switch (tensor.dtype()) {
+        case TF_FLOAT:
+        case TF_DOUBLE:
+        case TF_INT32:
+        case TF_INT64:
+            break;
+        default:
+            return false;
+    }
+    return tensor.device(true).find("CPU") != std::string_view::npos;
+}
+
+template<typename T>
+const T* host_data(const std::shared_ptr<TF_Tensor>& tensor) {
+    return static_cast<const T*>(TF_TensorData(tensor.get()));
+}
+
+// Integers wrap around like in the TensorFlow kernels, without the
+// undefined behaviour of signed overflow
+template<typename T, typename Op>
+T host_wrapping(T x, T y, Op op) {
+    if constexpr (std::is_integral_v<T>) {
+        using U = std::make_unsigned_t<T>;
+        return static_cast<T>(op(static_cast<U>(x), static_cast<U>(y)));
+    } else {
+        return op(x, y);
+    }
+}
+
+template<typename T>
+T host_apply(HostBinaryOp op, T x, T y) {
+    switch (op) {
+        case HostBinaryOp::kAdd:
+            return host_wrapping(x, y, [](auto a, auto b) { return a + b; });
+        case HostBinaryOp::kSub:
+            return host_wrapping(x, y, [](auto a, auto b) { return a - b; });
+        case HostBinaryOp::kMul:
+            return host_wrapping(x, y, [](auto a, auto b) { return a * b; });
+        case HostBinaryOp::kDiv:
+            return x / y;
+    }
+    return T {};
+}
+
+// One innermost run of a broadcast operation. Each operand either steps
+// through its elements or repeats one, so every variant is a plain loop
+// the compiler vectorises.
+template<typename T, HostBinaryOp Op>
+void host_binary_run(const T* x, bool x_steps, const T* y, bool y_steps,
+                     T* out, std::size_t count) {
+    if (x_steps && y_steps) {
+        for (std::size_t i = 0; i < count; ++i) {
+            out[i] = host_apply(Op, x[i], y[i]);
+        }
+    } else if (x_steps) {
+        auto value = *y;
+        for (std::size_t i = 0; i < count; ++i) {
+            out[i] = host_apply(Op, x[i], value);
+        }
+    } else if (y_steps) {
+        auto value = *x;
+        for (std::size_t i = 0; i < count; ++i) {
+            out[i] = host_apply(Op, value, y[i]);
+        }
+    } else {
+        std::fill(out, out + count, host_apply(Op, *x, *y));
+    }
+}
+
+template<typename T, HostBinaryOp Op>
+void host_binary_loop(const T* x, const std::vector<std::size_t>& x_strides,
+                      const T* y, const std::vector<std::size_t>& y_strides,
+                      T* out, const std::vector<std::size_t>& dims) {
+    auto rank = dims.size();
+    auto inner = dims[rank - 1];
+    auto index = std::array<std::size_t, kHostMaxRank> {};
+    auto x_offset = std::size_t {0};
+    auto y_offset = std::size_t {0};
+    auto outer = std::size_t {1};
+    for (std::size_t d = 0; d + 1 < rank; ++d) {
+        outer *= dims[d];
+    }
+    for (std::size_t run = 0; run < outer; ++run) {
+        host_binary_run<T, Op>(x + x_offset, x_strides[rank - 1] != 0,
+                               y + y_offset, y_strides[rank - 1] != 0,
+                               out + run * inner, inner);
+        // Advance the index of the outer dimensions
+        for (auto d = rank - 1; d-- > 0;) {
+            x_offset += x_strides[d];
+            y_offset += y_strides[d];
+            if (++index[d] < dims[d]) {
+                break;
+            }
+            x_offset -= x_strides[d] * dims[d];
+            y_offset -= y_strides[d] * dims[d];
+            index[d] = 0;
+        }
+    }
+}
+
+template<typename T>
+bool host_binary_typed(HostBinaryOp op,
+                       const std::shared_ptr<TF_Tensor>& x_tensor,
+                       const std::vector<std::size_t>& x_strides,
+                       const std::shared_ptr<TF_Tensor>& y_tensor,
+                       const std::vector<std::size_t>& y_strides, T* out,
+                       const std::vector<std::size_t>& dims) {
+    const auto* x = host_data<T>(x_tensor);
+    const auto* y = host_data<T>(y_tensor);
+    if constexpr (std::is_integral_v<T>) {
+        // Division by zero is reported by TensorFlow and min / -1
+        // overflows, so both are left to it
+        if (op == HostBinaryOp::kDiv) {
+            auto count = TF_TensorElementCount(y_tensor.get());
+            for (int64_t i = 0; i < count; ++i) {
+                if (y[i] == 0 || y[i] == -1) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    switch (op) {
+        case HostBinaryOp::kAdd:
+            host_binary_loop<T, HostBinaryOp::kAdd>(x, x_strides, y,
+                                                    y_strides, out, dims);
+            break;
+        case HostBinaryOp::kSub:
+            host_binary_loop<T, HostBinaryOp::kSub>(x, x_strides, y,
+                                                    y_strides, out, dims);
+            break;
+        case HostBinaryOp::kMul:
+            host_binary_loop<T, HostBinaryOp::kMul>(x, x_strides, y,
+                                                    y_strides, out, dims);
+            break;
+        case HostBinaryOp::kDiv:
+            host_binary_loop<T, HostBinaryOp::kDiv>(x, x_strides, y,
+                                                    y_strides, out, dims);
+            break;
+    }
+    return true;
+}
+
+/**
+ * Computes x op y with broadcasting on the host
+ * @return The result, or nothing if the fast path does not apply
+ */
+inline std::optional<Tensor> host_binary(HostBinaryOp op, const Tensor& x,
+                                         const Tensor& y) {
+    if (!host_math_state().enabled.load(std::memory_order_relaxed)
+        || get_global_context().is_async() || x.is_symbolic()
+        || y.is_symbolic() || x.dtype() != y.dtype()) {
+        return std::nullopt;
+    }
+
+    // Broadcast the shapes, aligned on their last dimension
+    auto x_dims = x.dims();
+    auto y_dims = y.dims();
+    auto rank = std::max(x_dims.rank(), y_dims.rank());
+    if (rank > kHostMaxRank) {
+        return std::nullopt;
+    }
+    auto out_dims = std::vector<int64_t>(rank);
+    auto x_extents = std::vector<std::size_t>(rank, 1);
+    auto y_extents = std::vector<std::size_t>(rank, 1);
+    auto elements = std::size_t {1};
+    for (std::size_t d = 0; d < rank; ++d) {
+        if (d < x_dims.rank()) {
+            x_extents[rank - 1 - d] = static_cast<std::size_t>(
+                x_dims[x_dims.rank() - 1 - d]);
+        }
+        if (d < y_dims.rank()) {
+            y_extents[rank - 1 - d] = static_cast<std::size_t>(
+                y_dims[y_dims.rank() - 1 - d]);
+        }
+    }
+    for (std::size_t d = 0; d < rank; ++d) {
+        if (x_extents[d] != y_extents[d] && x_extents[d] != 1
+            && y_extents[d] != 1) {
+            // Incompatible shapes, TensorFlow reports the error
+            return std::nullopt;
+        }
+        auto extent = x_extents[d] == 1 ? y_extents[d] : x_extents[d];
+        out_dims[d] = static_cast<int64_t>(extent);
+        elements *= extent;
+    }
+    if (!host_math_applies(x, elements) || !host_math_applies(y, elements)) {
+        return std::nullopt;
+    }
+
+    // Element strides, zero along broadcast dimensions. Dimensions both
+    // operands traverse the same way are merged, so that e.g. equal shapes
+    // become one flat loop.
+    auto dims = std::vector<std::size_t> {};
+    auto x_strides = std::vector<std::size_t> {};
+    auto y_strides = std::vector<std::size_t> {};
+    auto x_stride = std::size_t {1};
+    auto y_stride = std::size_t {1};
+    for (auto d = rank; d-- > 0;) {
+        auto extent = static_cast<std::size_t>(out_dims[d]);
+        auto xs = x_extents[d] == 1 ? 0 : x_stride;
+        auto ys = y_extents[d] == 1 ? 0 : y_stride;
+        x_stride *= x_extents[d];
+        y_stride *= y_extents[d];
+        if (extent == 1) {
+            continue;
+        }
+        if (!dims.empty() && xs == x_strides.back() * dims.back()
+            && ys == y_strides.back() * dims.back()) {
+            dims.back() *= extent;
+            continue;
+        }
+        dims.push_back(extent);
+        x_strides.push_back(xs);
+        y_strides.push_back(ys);
+    }
+    if (dims.empty()) {
+        dims.push_back(1);
+        x_strides.push_back(0);
+        y_strides.push_back(0);
+    }
+    std::reverse(dims.begin(), dims.end());
+    std::reverse(x_strides.begin(), x_strides.end());
+    std::reverse(y_strides.begin(), y_strides.end());
+
+    auto dtype = x.dtype();
+    auto result = std::shared_ptr<TF_Tensor> {
+        TF_AllocateTensor(dtype, out_dims.data(), static_cast<int>(rank),
+                          elements * TF_DataTypeSize(dtype)),
+        TF_DeleteTensor};
+    auto* out = TF_TensorData(result.get());
+    auto x_tensor = x.get_tensor();
+    auto y_tensor = y.get_tensor();
+    auto computed = false;
+    if (elements == 0) {
+        computed = true;
+    } else if (dtype == TF_FLOAT) {
+        computed = host_binary_typed(op, x_tensor, x_strides, y_tensor,
+                                     y_strides, static_cast<float*>(out),
+                                     dims);
+    } else if (dtype == TF_DOUBLE) {
+        computed = host_binary_typed(op, x_tensor, x_strides, y_tensor,
+                                     y_strides, static_cast<double*>(out),
+                                     dims);
+    } else if (dtype == TF_INT32) {
+        computed = host_binary_typed(op, x_tensor, x_strides, y_tensor,
+                                     y_strides, static_cast<int32_t*>(out),
+                                     dims);
+    } else {
+        computed = host_binary_typed(op, x_tensor, x_strides, y_tensor,
+                                     y_strides, static_cast<int64_t*>(out),
+                                     dims);
+    }
+    if (!computed) {
+        return std::nullopt;
+    }
+    return Tensor {std::move(result)};
+}
+
+template<typename T>
+T host_reduce_init(HostReduceOp op) {
+    switch (op) {
+        case HostReduceOp::kMax:
+            if constexpr (std::numeric_limits<T>::has_infinity) {
+                return -std::numeric_limits<T>::infinity();
+            }
+            return std::numeric_limits<T>::lowest();
+        case HostReduceOp::kMin:
+            if constexpr (std::numeric_limits<T>::has_infinity) {
+                return std::numeric_limits<T>::infinity();
+            }
+            return std::numeric_limits<T>::max();
+        default:
+            return T {0};
+    }
+}
+
+template<typename T, HostReduceOp Op>
+T host_combine(T accumulated, T value) {
+    if constexpr (Op == HostReduceOp::kMax) {
+        return value > accumulated ? value : accumulated;
+    } else if constexpr (Op == HostReduceOp::kMin) {
+        return value < accumulated ? value : accumulated;
+    } else {
+        return host_wrapping(accumulated, value,
+                             [](auto a, auto b) { return a + b; });
+    }
+}
+
+// Reduces the input, whose merged dimensions alternate between kept and
+// reduced, into `out`
+template<typename T, HostReduceOp Op>
+void host_reduce_loop(const T* in, const std::vector<std::size_t>& dims,
+                      const std::vector<bool>& reduced, T* out) {
+    auto rank = dims.size();
+    auto inner = dims[rank - 1];
+    // Output strides, zero along reduced dimensions
+    auto out_strides = std::vector<std::size_t>(rank);
+    auto stride = std::size_t {1};
+    for (auto d = rank; d-- > 0;) {
+        out_strides[d] = reduced[d] ? 0 : stride;
+        stride *= reduced[d] ? 1 : dims[d];
+    }
+
+    auto index = std::array<std::size_t, kHostMaxRank> {};
+    auto out_offset = std::size_t {0};
+    auto outer = std::size_t {1};
+    for (std::size_t d = 0; d + 1 < rank; ++d) {
+        outer *= dims[d];
+    }
+    for (std::size_t run = 0; run < outer; ++run) {
+        const auto* values = in + run * inner;
+        auto* target = out + out_offset;
+        if (reduced[rank - 1]) {
+            auto accumulated = *target;
+            for (std::size_t i = 0; i < inner; ++i) {
+                accumulated = host_combine<T, Op>(accumulated, values[i]);
+            }
+            *target = accumulated;
+        } else {
+            for (std::size_t i = 0; i < inner; ++i) {
+                target[i] = host_combine<T, Op>(target[i], values[i]);
+            }
+        }
+        for (auto d = rank - 1; d-- > 0;) {
+            out_offset += out_strides[d];
+            if (++index[d] < dims[d]) {
+                break;
+            }
+            out_offset -= out_strides[d] * dims[d];
+            index[d] = 0;
+        }
+    }
+}
+
+template<typename T>
+void host_reduce_typed(HostReduceOp op, const T* in,
+                       const std::vector<std::size_t>& dims,
+                       const std::vector<bool>& reduced, T* out,
+                       std::size_t out_elements, std::size_t count) {
+    std::fill(out, out + out_elements, host_reduce_init<T>(op));
+    switch (op) {
+        case HostReduceOp::kSum:
+        case HostReduceOp::kMean:
+            host_reduce_loop<T, HostReduceOp::kSum>(in, dims, reduced, out);
+            break;
+        case HostReduceOp::kMax:
+            host_reduce_loop<T, HostReduceOp::kMax>(in, dims, reduced, out);
+            break;
+        case HostReduceOp::kMin:
+            host_reduce_loop<T, HostReduceOp::kMin>(in, dims, reduced, out);
+            break;
+    }
+    if (op == HostReduceOp::kMean) {
+        for (std::size_t i = 0; i < out_elements; ++i) {
+            out[i] /= static_cast<T>(count);
+        }
+    }
+}
+
+/**
+ * Reduces the input along `axes` on the host, all of them if empty
+ * @return The result, or nothing if the fast path does not apply
+ */
+inline std::optional<Tensor> host_reduce(HostReduceOp op,
+                                         const Tensor& input,
+                                         const std::vector<int64_t>& axes,
+                                         bool keep_dims) {
+    if (get_global_context().is_async() || input.is_symbolic()) {
+        return std::nullopt;
+    }
+    auto input_dims = input.dims();
+    auto rank = input_dims.rank();
+    auto elements = static_cast<std::size_t>(input_dims.num_elements());
+    // Empty reductions are left to TensorFlow
+    if (rank > kHostMaxRank || elements == 0
+        || !host_math_applies(input, elements)) {
+        return std::nullopt;
+    }
+
+    auto reduced = std::vector<bool>(rank, axes.empty());
+    for (auto axis : axes) {
+        auto d = axis < 0 ? axis + static_cast<int64_t>(rank) : axis;
+        if (d < 0 || d >= static_cast<int64_t>(rank)
+            || reduced[static_cast<std::size_t>(d)]) {
+            // Invalid axes, TensorFlow reports the error
+            return std::nullopt;
+        }
+        reduced[static_cast<std::size_t>(d)] = true;
+    }
+
+    auto out_dims = std::vector<int64_t> {};
+    auto out_elements = std::size_t {1};
+    auto count = std::size_t {1};
+    auto dims = std::vector<std::size_t> {};
+    auto merged = std::vector<bool> {};
+    for (std::size_t d = 0; d < rank; ++d) {
+        auto extent = static_cast<std::size_t>(input_dims[d]);
+        if (reduced[d]) {
+            count *= extent;
+            if (keep_dims) {
+                out_dims.push_back(1);
+            }
+        } else {
+            out_elements *= extent;
+            out_dims.push_back(input_dims[d]);
+        }
+        // Neighbouring dimensions that are both kept or both reduced merge
+        if (extent == 1) {
+            continue;
+        }
+        if (!merged.empty() && merged.back() == reduced[d]) {
+            dims.back() *= extent;
+        } else {
+            dims.push_back(extent);
+            merged.push_back(reduced[d]);
+        }
+    }
+    if (dims.empty()) {
+        dims.push_back(1);
+        merged.push_back(true);
+    }
+
+    auto dtype = input.dtype();
+    auto result = std::shared_ptr<TF_Tensor> {
+        TF_AllocateTensor(dtype, out_dims.data(),
+                          static_cast<int>(out_dims.size()),
+                          out_elements * TF_DataTypeSize(dtype)),
+        TF_DeleteTensor};
+    auto* out = TF_TensorData(result.get());
+    auto tensor = input.get_tensor();
+    switch (dtype) {
+        case TF_FLOAT:
+            host_reduce_typed(op, host_data<float>(tensor), dims, merged,
+                              static_cast<float*>(out), out_elements, count);
+            break;
+        case TF_DOUBLE:
+            host_reduce_typed(op, host_data<double>(tensor), dims, merged,
+                              static_cast<double*>(out), out_elements, count);
+            break;
+        case TF_INT32:
+            host_reduce_typed(op, host_data<int32_t>(tensor), dims, merged,
+                              static_cast<int32_t*>(out), out_elements,
+                              count);
+            break;
+        default:
+            host_reduce_typed(op, host_data<int64_t>(tensor), dims, merged,
+                              static_cast<int64_t*>(out), out_elements,
+                              count);
+            break;
+    }
+    return Tensor {std::move(result)};
+}
+
+}    // namespace detail
+
+inline void set_host_math_options(const HostMathOptions& options) {
+    auto& state = detail::host_math_state();
+    state.enabled.store(options.enabled, std::memory_order_relaxed);
+    state.max_elements.store(options.max_elements, std::memory_order_relaxed);
+}
+
+inline HostMathOptions host_math_options() {
+    auto& state = detail::host_math_state();
+    auto options = HostMathOptions {};
+    options.enabled = state.enabled.load(std::memory_order_relaxed);
+    options.max_elements = state.max_elements.load(std::memory_order_relaxed);
+    return options;
+}
+
+}    // namespace cppflow
+
+#endif
@@ -0,0 +1,319 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_IMAGE_H__
+#define __CPPFLOW2_IMAGE_H__
+
+#include "datatype.h"
+#include "tensor.h"
+#include "tensor_view.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace cppflow {
+
+enum class PixelFormat { kGray, kRGB, kBGR, kRGBA, kBGRA };
+
+enum class Layout { kNHWC, kNCHW };
+
+/**
+ * A non-owning view of 8-bit interleaved pixels
+ */
+struct Image {
+    const uint8_t* data {nullptr};
+    std::size_t width {0};
+    std::size_t height {0};
+    PixelFormat format {PixelFormat::kRGB};
+    // Bytes from one row to the next, 0 for rows without padding
+    std::size_t row_stride {0};
+
+    /**
+     * Views a decoded uint8 [height, width, channels] tensor, as returned by
+     * DecodeJpeg or DecodePng, as gray, RGB or RGBA pixels. The tensor must
+     * outlive the image.
+     * @throw std::runtime_error if the tensor is not such an image
+     */
+    static Image from_tensor(const Tensor& tensor);
+};
+
+struct PreprocessOptions {
+    Layout layout {Layout::kNHWC};
+    // The channels written, one of kGray, kRGB and kBGR
+    PixelFormat channels {PixelFormat::kRGB};
+    // Values written are (pixel * scale - mean[c]) / stddev[c]
+    float scale {1.0f};
+    std::array<float, 3> mean {0.0f, 0.0f, 0.0f};
+    std::array<float, 3> stddev {1.0f, 1.0f, 1.0f};
+};
+
+/**
+ * Resizes, converts and normalises an image into one slot of a float batch
+ * in a single pass, replacing a chain of eager ops that would each produce
+ * a full-size tensor. Resizing is bilinear with half pixel centers, as
+ * tf.image.resize. The output size is the size of the batch.
+ *
+ *     auto batch = TensorBuilder<float> {{n, 224, 224, 3}};
+ *     for (std::size_t i = 0; i < n; ++i) {
+ *         auto pixels = DecodeJpeg(ReadFile(Tensor {files[i]}), 3);
+ *         preprocess_image(Image::from_tensor(pixels), batch.view<4>(), i);
+ *     }
+ *     auto input = batch.finish();
+ *
+ * @param image The source pixels
+ * @param batch A [N, H, W, C] or [N, C, H, W] view, as options.layout says
+ * @param index The slot of the batch to write
+ * @param options Channels, normalisation and layout of the output
+ * @throw std::runtime_error if the image is empty or the batch does not
+ * match the options
+ */
+inline void preprocess_image(const Image& image, TensorView<float, 4> batch,
+                             std::size_t index,
+                             const PreprocessOptions& options = {});
+
+}    // namespace cppflow
+
+
+namespace cppflow {
+
+namespace detail {
+
+inline std::size_t pixel_channels(PixelFormat format) {
+    switch (format) {
+        case PixelFormat::kGray:
+            return 1;
+        case PixelFormat::kRGB:
+        case PixelFormat::kBGR:
+            return 3;
+        case PixelFormat::kRGBA:
+        case PixelFormat::kBGRA:
+            return 4;
+    }
+    return 0;
+}
+
+struct ResizeTap {
+    std::size_t lower;
+    std::size_t upper;
+    float weight;
+};
+
+// The source pixels every output coordinate interpolates between
+inline std::vector<ResizeTap> resize_taps(std::size_t in, std::size_t out) {
+    auto taps = std::vector<ResizeTap>(out);
+    auto scale = static_cast<float>(in) / static_cast<float>(out);
+    auto last = static_cast<float>(in - 1);
+    for (std::size_t i = 0; i < out; ++i) {
+        auto position = (static_cast<float>(i) + 0.5f) * scale - 0.5f;
+        auto lower = std::floor(position);
+        taps[i] = {static_cast<std::size_t>(std::max(lower, 0.0f)),
+                   static_cast<std::size_t>(
+                       std::clamp(std::ceil(position), 0.0f, last)),
+                   position - lower};
+    }
+    return taps;
+}
+
+// Weights of the source channels in every output channel
+inline std::array<std::array<float, 4>, 3> color_matrix(PixelFormat from,
+                                                        PixelFormat to) {
+    auto matrix = std::array<std::array<float, 4>, 3> {};
+    if (from == PixelFormat::kGray) {
+        for (auto& row : matrix) {
+            row[0] = 1.0f;
+        }
+        return matrix;
+    }
+
+    auto bgr = from == PixelFormat::kBGR || from == PixelFormat::kBGRA;
+    auto red = std::size_t {bgr ? 2u : 0u};
+    auto blue = std::size_t {bgr ? 0u : 2u};
+    switch (to) {
+        case PixelFormat::kGray:
+            // ITU-R BT.601 luma, as tf.image.rgb_to_grayscale
+            matrix[0][red] = 0.2989f;
+            matrix[0][1] = 0.587f;
+            matrix[0][blue] = 0.114f;
+            break;
+        case PixelFormat::kBGR:
+            std::swap(red, blue);
+            [[fallthrough]];
+        default:
+            matrix[0][red] = 1.0f;
+            matrix[1][1] = 1.0f;
+            matrix[2][blue] = 1.0f;
+            break;
+    }
+    return matrix;
+}
+
+}    // namespace detail
+
+inline Image Image::from_tensor(const Tensor& tensor) {
+    auto dims = tensor.dims();
+    if (tensor.dtype() != TF_UINT8 || dims.rank() != 3) {
+        throw std::runtime_error("An image tensor must be uint8 [height, "
+                                 "width, channels], not "
+                                 + to_string(tensor.dtype()) + " "
+                                 + dims.to_string());
+    }
+
+    auto image = Image {};
+    switch (dims[2]) {
+        case 1:
+            image.format = PixelFormat::kGray;
+            break;
+        case 3:
+            image.format = PixelFormat::kRGB;
+            break;
+        case 4:
+            image.format = PixelFormat::kRGBA;
+            break;
+        default:
+            throw std::runtime_error("An image tensor must have 1, 3 or 4 "
+                                     "channels, not "
+                                     + std::to_string(dims[2]));
+    }
+    image.data = tensor.get_data<uint8_t>().data();
+    image.height = static_cast<std::size_t>(dims[0]);
+    image.width = static_cast<std::size_t>(dims[1]);
+    return image;
+}
+
+inline void preprocess_image(const Image& image, TensorView<float, 4> batch,
+                             std::size_t index,
+                             const PreprocessOptions& options) {
+    auto nchw = options.layout == Layout::kNCHW;
+    auto height = batch.extent(nchw ? 2 : 1);
+    auto width = batch.extent(nchw ? 3 : 2);
+    auto channels = batch.extent(nchw ? 1 : 3);
+    auto out_stride = std::array<std::size_t, 3> {};    // y, x, channel
+    out_stride[0] = batch.stride(nchw ? 2 : 1);
+    out_stride[1] = batch.stride(nchw ? 3 : 2);
+    out_stride[2] = batch.stride(nchw ? 1 : 3);
+
+    if (options.channels != PixelFormat::kGray
+        && options.channels != PixelFormat::kRGB
+        && options.channels != PixelFormat::kBGR) {
+        throw std::runtime_error("Images can only be preprocessed into gray, "
+                                 "RGB or BGR channels");
+    }
+    if (channels != detail::pixel_channels(options.channels)) {
+        throw std::runtime_error(
+            "The batch has " + std::to_string(channels) + " channels but "
+            + std::to_string(detail::pixel_channels(options.channels))
+            + " were requested");
+    }
+    if (index >= batch.extent(0)) {
+        throw std::runtime_error("Batch slot " + std::to_string(index)
+                                 + " is out of range");
+    }
+    if (!image.data || image.width == 0 || image.height == 0) {
+        throw std::runtime_error("Cannot preprocess an empty image");
+    }
+    if (width == 0 || height == 0) {
+        return;
+    }
+
+    // Colour conversion and normalisation fold into one affine map per
+    // output channel
+    auto in_channels = detail::pixel_channels(image.format);
+    auto matrix = detail::color_matrix(image.format, options.channels);
+    auto offset = std::array<float, 3> {};
+    for (std::size_t c = 0; c < channels; ++c) {
+        for (auto& weight : matrix[c]) {
+            weight *= options.scale / options.stddev[c];
+        }
+        offset[c] = -options.mean[c] / options.stddev[c];
+    }
+
+    auto row_stride = image.row_stride ? image.row_stride
+                                       : image.width * in_channels;
+    auto xs = detail::resize_taps(image.width, width);
+    auto ys = detail::resize_taps(image.height, height);
+
+    // Source rows resized horizontally, one plane per source channel. Every
+    // loop below runs over contiguous floats so the compiler vectorises it.
+    auto plane = width;
+    auto rows = std::array<std::vector<float>, 2> {
+        std::vector<float>(in_channels * plane),
+        std::vector<float>(in_channels * plane)};
+    auto row_of = std::array<std::size_t, 2> {image.height, image.height};
+    auto blended = std::vector<float>(in_channels * plane);
+    auto values = std::vector<float>(plane);
+
+    auto resize_row = [&](std::size_t y, std::vector<float>& row) {
+        const auto* src = image.data + y * row_stride;
+        for (std::size_t x = 0; x < width; ++x) {
+            const auto& tap = xs[x];
+            const auto* lower = src + tap.lower * in_channels;
+            const auto* upper = src + tap.upper * in_channels;
+            for (std::size_t k = 0; k < in_channels; ++k) {
+                auto a = static_cast<float>(lower[k]);
+                auto b = static_cast<float>(upper[k]);
+                row[k * plane + x] = a + tap.weight * (b - a);
+            }
+        }
+    };
+
+    auto* slot = batch.data() + index * batch.stride(0);
+    for (std::size_t y = 0; y < height; ++y) {
+        const auto& tap = ys[y];
+        // Neighbouring output rows mostly share their source rows
+        if (row_of[0] != tap.lower) {
+            if (row_of[1] == tap.lower) {
+                std::swap(rows[0], rows[1]);
+                std::swap(row_of[0], row_of[1]);
+            } else {
+                resize_row(tap.lower, rows[0]);
+                row_of[0] = tap.lower;
+            }
+        }
+        if (row_of[1] != tap.upper) {
+            resize_row(tap.upper, rows[1]);
+            row_of[1] = tap.upper;
+        }
+
+        const auto* top = rows[0].data();
+        const auto* bottom = rows[1].data();
+        auto weight = tap.weight;
+        for (std::size_t i = 0; i < blended.size(); ++i) {
+            blended[i] = top[i] + weight * (bottom[i] - top[i]);
+        }
+
+        for (std::size_t c = 0; c < channels; ++c) {
+            auto* out = slot + y * out_stride[0] + c * out_stride[2];
+            auto step = out_stride[1];
+            auto* value = step == 1 ? out : values.data();
+            std::fill(value, value + width, offset[c]);
+            for (std::size_t k = 0; k < in_channels; ++k) {
+                auto scale = matrix[c][k];
+                if (scale == 0.0f) {
+                    continue;
+                }
+                const auto* source = blended.data() + k * plane;
+                for (std::size_t x = 0; x < width; ++x) {
+                    value[x] += scale * source[x];
+                }
+            }
+            if (step != 1) {
+                for (std::size_t x = 0; x < width; ++x) {
+                    out[x * step] = value[x];
+                }
+            }
+        }
+    }
+}
+
+}    // namespace cppflow
+
+#endif
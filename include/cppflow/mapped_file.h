@@ -0,0 +1,135 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_MAPPED_FILE_H__
+#define __CPPFLOW2_MAPPED_FILE_H__
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CPPFLOW2_HAS_MMAP 1
+#endif
+
+
+namespace cppflow {
+
+/**
+ * @class MappedFile
+ * @brief A read-only view of a whole file
+ *
+ * The file is memory-mapped where the platform supports it, so its pages
+ * are loaded on demand and shared with every other process mapping it.
+ * Elsewhere it is read into memory. Copies share the same mapping, which
+ * stays valid as long as one of them is alive.
+ */
+class MappedFile {
+public:
+    /**
+     * @param filename The file to map
+     * @param copy_on_write Map the pages writable and private, so that
+     * writes through data() only affect this process and never the file
+     */
+    explicit MappedFile(const std::filesystem::path& filename,
+                        bool copy_on_write = false);
+
+    MappedFile(const MappedFile& other) = default;
+    MappedFile(MappedFile&& other) noexcept = default;
+    MappedFile& operator=(const MappedFile& other) = default;
+    MappedFile& operator=(MappedFile&& other) noexcept = default;
+
+    const char* data() const {
+        return impl_->data;
+    }
+
+    std::size_t size() const {
+        return impl_->size;
+    }
+
+    std::string_view view() const {
+        return {data(), size()};
+    }
+
+private:
+    struct Impl {
+        const char* data {nullptr};
+        std::size_t size {0};
+        // Only used without mmap support
+        std::string contents;
+
+        Impl() = default;
+        Impl(const Impl&) = delete;
+        Impl& operator=(const Impl&) = delete;
+        ~Impl();
+    };
+
+    std::shared_ptr<Impl> impl_;
+};
+
+}    // namespace cppflow
+
+
+namespace cppflow {
+
+inline MappedFile::MappedFile(const std::filesystem::path& filename,
+                              bool copy_on_write)
+    : impl_(std::make_shared<Impl>()) {
+#if defined(CPPFLOW2_HAS_MMAP)
+    auto fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Could not open " + filename.string());
+    }
+    struct stat info {};
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw std::runtime_error("Could not stat " + filename.string());
+    }
+    impl_->size = static_cast<std::size_t>(info.st_size);
+    if (impl_->size > 0) {
+        auto* data = copy_on_write
+                         ? ::mmap(nullptr, impl_->size, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE, fd, 0)
+                         : ::mmap(nullptr, impl_->size, PROT_READ, MAP_SHARED,
+                                  fd, 0);
+        if (data == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("Could not map " + filename.string());
+        }
+        impl_->data = static_cast<const char*>(data);
+    }
+    // The mapping stays valid once the descriptor is closed
+    ::close(fd);
+#else
+    static_cast<void>(copy_on_write);
+    auto file = std::ifstream {filename, std::ios::binary};
+    if (!file) {
+        throw std::runtime_error("Could not open " + filename.string());
+    }
+    impl_->contents.assign(std::istreambuf_iterator<char> {file}, {});
+    impl_->data = impl_->contents.data();
+    impl_->size = impl_->contents.size();
+#endif
+}
+
+inline MappedFile::Impl::~Impl() {
+#if defined(CPPFLOW2_HAS_MMAP)
+    if (data && size > 0) {
+        ::munmap(const_cast<char*>(data), size);
+    }
+#endif
+}
+
+}    // namespace cppflow
+
+#endif
@@ -5,15 +5,32 @@
 #ifndef CPPFLOW2_MODEL_H
 #define CPPFLOW2_MODEL_H
 
+#include "awaitable.h"
 #include "buffer.h"
 #include "context.h"
 #include "defer.h"
+#include "executor.h"
+#include "graph_def.h"
+#include "mapped_file.h"
+#include "npy.h"
+#include "profiler.h"
+#include "runner.h"
 #include "session_options.h"
+#include "signature.h"
+#include "small_buffer.h"
 #include "tensor.h"
+#include "warmup.h"
 
 #include <tensorflow/c/c_api.h>
 
+#include <algorithm>
 #include <charconv>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <map>
 #include <memory>
 #include <string>
 #include <tuple>
@@ -32,7 +49,81 @@ public:
         : Model(filename, {tag}) {
     }
     explicit Model(const std::string_view& filename,
-                   const std::initializer_list<std::string_view>& tags);
+                   const std::initializer_list<std::string_view>& tags)
+        : Model(filename, std::vector<std::string_view> {tags},
+                SessionOptions {}) {
+    }
+    explicit Model(const std::string_view& filename,
+                   const SessionOptions& session_options)
+        : Model(filename, {"serve"}, session_options) {
+    }
+    explicit Model(const std::string_view& filename,
+                   const SessionOptionsBuilder& session_options)
+        : Model(filename, {"serve"}, session_options.build()) {
+    }
+    explicit Model(const std::string_view& filename,
+                   const std::vector<std::string_view>& tags,
+                   const SessionOptions& session_options)
+        : Model(filename, tags, session_options, WarmupOptions {}) {
+    }
+
+    /**
+     * Loads a SavedModel and warms it up before returning
+     * @param filename Path of the SavedModel
+     * @param tags Tags of the MetaGraphDef to load
+     * @param session_options Options of the session
+     * @param warmup Signatures to run and recorded requests to replay
+     */
+    explicit Model(const std::string_view& filename,
+                   const std::vector<std::string_view>& tags,
+                   const SessionOptions& session_options,
+                   const WarmupOptions& warmup);
+
+    /**
+     * Loads a graph saved by FrozenGraph::save() into a new session. The
+     * weights are memory-mapped with read_npz() and fed to every run as
+     * tensors over the mapped pages: nothing is restored or copied at load
+     * time, pages are read on first use, and processes loading the same
+     * file share them through the page cache. The model has no signatures.
+     * @param filename Path of the GraphDef
+     * @param weights Path of the .npz archive holding the weights
+     * @param session_options Options of the session
+     */
+    static Model from_graph_def(
+        const std::string_view& filename, const std::string_view& weights,
+        const SessionOptions& session_options = SessionOptions {});
+
+    /**
+     * Loads a self-contained binary GraphDef, such as one frozen into Const
+     * nodes by TensorFlow's tools, into a new session. TensorFlow parses the
+     * constants into its own memory, so every process holds a copy of them,
+     * and GraphDefs are limited to 2GB. The model has no signatures.
+     * @param filename Path of the GraphDef
+     * @param session_options Options of the session
+     */
+    static Model from_graph_def(
+        const std::string_view& filename,
+        const SessionOptions& session_options = SessionOptions {});
+
+    /**
+     * Freezes the current variable values and returns the graph needed to
+     * compute `outputs`, to be saved once with FrozenGraph::save() and loaded
+     * with from_graph_def() afterwards. Resource variables are read through
+     * ReadVariableOp nodes added to the graph. See freeze_graph_def() for the
+     * limitations.
+     * @param outputs Names of the outputs the frozen graph must provide
+     * @return The GraphDef and the variable values
+     */
+    FrozenGraph freeze(const std::vector<std::string>& outputs);
+
+    /**
+     * Runs the model a few times so that kernels are created and allocators
+     * grown before serving. Inputs of the requested signatures are filled
+     * with zeros (empty strings for string inputs) shaped after the graph,
+     * using `unknown_dim` for unknown dimensions. Recorded requests from
+     * assets.extra/tf_serving_warmup_requests are replayed if asked for.
+     */
+    void warmup(const WarmupOptions& options);
 
     std::vector<std::string> get_operations() const;
     std::vector<int64_t> get_operation_shape(
@@ -49,6 +140,131 @@ public:
         const std::vector<T>& outputs);
     Tensor forward(const Tensor& input);
 
+    using ForwardCallback
+        = std::function<void(std::vector<Tensor>, std::exception_ptr)>;
+
+    /**
+     * Runs forward() on an executor thread
+     * @param executor The worker pool to run on
+     * @return A future holding the outputs
+     * @throw RejectedError if the executor queue is full
+     */
+    std::future<std::vector<Tensor>> forward_async(
+        std::vector<std::tuple<std::string, Tensor>> inputs,
+        std::vector<std::string> outputs,
+        Executor& executor = *default_executor()) const;
+    std::future<Tensor> forward_async(
+        const Tensor& input, Executor& executor = *default_executor()) const;
+
+    /**
+     * Runs forward() on an executor thread and calls `callback` from that
+     * thread with either the outputs or the exception that was thrown. An
+     * exception thrown by `callback` goes to the executor's error handler,
+     * see Executor::set_error_handler()
+     * @throw RejectedError if the executor queue is full
+     */
+    void forward_async(std::vector<std::tuple<std::string, Tensor>> inputs,
+                       std::vector<std::string> outputs,
+                       ForwardCallback callback,
+                       Executor& executor = *default_executor()) const;
+
+    /**
+     * Awaitable version of forward() for C++20 coroutines. The session runs
+     * on an executor thread and the coroutine is resumed through `scheduler`
+     *
+     *     auto outputs = co_await model.run(inputs, {"output:0"});
+     *
+     * @param scheduler Where to resume the coroutine, the worker by default
+     * @param executor The worker pool to run on
+     */
+    Awaitable<std::vector<Tensor>> run(
+        std::vector<std::tuple<std::string, Tensor>> inputs,
+        std::vector<std::string> outputs, Scheduler scheduler = {},
+        Executor& executor = *default_executor()) const {
+        return awaitable(
+            [model = *this, inputs = std::move(inputs),
+             outputs = std::move(outputs)]() mutable {
+                return model.forward(inputs, outputs);
+            },
+            std::move(scheduler), executor);
+    }
+    Awaitable<Tensor> run(const Tensor& input, Scheduler scheduler = {},
+                          Executor& executor = *default_executor()) const {
+        return awaitable(
+            [model = *this, input]() mutable { return model.forward(input); },
+            std::move(scheduler), executor);
+    }
+
+    /**
+     * Resolves the given input and output names once and returns a Runner
+     * that can be invoked repeatedly without any name lookups
+     * @param inputs Names of the inputs, in the order they will be fed
+     * @param outputs Names of the outputs, in the order they are returned
+     * @return A Runner bound to this model's graph and session
+     */
+    Runner prepare(const std::vector<std::string_view>& inputs,
+                   const std::vector<std::string_view>& outputs) const;
+    template<typename T,
+             std::enable_if_t<
+                 std::is_nothrow_convertible_v<T, std::string_view>
+                     && !std::is_same_v<T, std::string_view>,
+                 int> = 0>
+    Runner prepare(const std::vector<T>& inputs,
+                   const std::vector<T>& outputs) const {
+        return prepare(
+            std::vector<std::string_view>(inputs.begin(), inputs.end()),
+            std::vector<std::string_view>(outputs.begin(), outputs.end()));
+    }
+
+    /**
+     * @return The signatures of the SavedModel, with their inputs and
+     * outputs resolved against the loaded graph
+     */
+    const std::map<std::string, SignatureDef>& get_signatures() const {
+        return *signatures_;
+    }
+
+    /**
+     * @param key The signature key, e.g. "serving_default"
+     * @throw std::runtime_error if the model has no such signature
+     */
+    const SignatureDef& get_signature(const std::string& key) const;
+
+    /**
+     * Returns a Runner over a signature, addressed by the logical names of
+     * its inputs and outputs instead of graph tensor names
+     * @param key The signature key, e.g. "serving_default"
+     * @param inputs Logical input names, in the order they will be fed
+     * @param outputs Logical output names, in the order they are returned.
+     * All outputs, sorted by name, if empty
+     */
+    Runner prepare_signature(const std::string& key,
+                             const std::vector<std::string>& inputs,
+                             const std::vector<std::string>& outputs
+                             = {}) const;
+
+    /**
+     * Runs a signature with inputs keyed by their logical names
+     * @param key The signature key, e.g. "serving_default"
+     * @return Every output of the signature, keyed by its logical name
+     */
+    std::map<std::string, Tensor> forward_signature(
+        const std::string& key, const std::map<std::string, Tensor>& inputs);
+
+    /**
+     * Enables traced runs. Runs sampled by the profiler are executed with
+     * trace_level=FULL_TRACE and their step stats recorded into it. Affects
+     * forward() and the Runners prepared afterwards
+     * @param profiler The profiler, or nullptr to disable tracing
+     */
+    void set_profiler(std::shared_ptr<Profiler> profiler) {
+        profiler_ = std::move(profiler);
+    }
+
+    const std::shared_ptr<Profiler>& get_profiler() const {
+        return profiler_;
+    }
+
     std::vector<Tensor> operator()(
         const std::vector<std::tuple<std::string, Tensor>>& inputs,
         const std::vector<std::string>& outputs) {
@@ -72,9 +288,29 @@ public:
     Model& operator=(const Model& other) = default;
     Model& operator=(Model&& other) = default;
 
+private:
+    // Reads the session use count to tell when a retired version drained
+    friend class ModelManager;
+
+    Model(std::shared_ptr<TF_Graph> graph, std::shared_ptr<TF_Session> session)
+        : graph_(std::move(graph)),
+          session_(std::move(session)),
+          signatures_(std::make_shared<std::map<std::string, SignatureDef>>()) {
+    }
+
+    TF_Output resolve_output(const std::string_view& name) const;
+    std::vector<int64_t> get_output_shape(const TF_Output& output) const;
+    Tensor synthesize_input(const std::string_view& name,
+                            int64_t unknown_dim) const;
+
 private:
     std::shared_ptr<TF_Graph> graph_;
     std::shared_ptr<TF_Session> session_;
+    std::shared_ptr<Profiler> profiler_;
+    // Fed to every run, see from_graph_def()
+    std::shared_ptr<const detail::BoundInputs> bound_inputs_;
+    std::string export_dir_;
+    std::shared_ptr<const std::map<std::string, SignatureDef>> signatures_;
 };
 
 }    // namespace cppflow
@@ -82,10 +318,26 @@ private:
 
 namespace cppflow {
 
+inline std::tuple<std::string, int32_t> parse_name(
+    const std::string_view& name) {
+    auto pos = name.find(':');
+    if (pos == std::string_view::npos) {
+        return std::make_tuple(std::string {name}, 0);
+    }
+
+    auto prefix = name.substr(0, pos);
+    auto suffix = name.substr(pos + 1);
+    int32_t index = 0;
+    std::from_chars(suffix.begin(), suffix.end(), index, 10);
+
+    return std::make_tuple(std::string {prefix}, index);
+}
+
 inline Model::Model(const std::string_view& filename,
-                    const std::initializer_list<std::string_view>& tags)
-    : graph_(TF_NewGraph(), TF_DeleteGraph) {
-    auto session_options = SessionOptions {};
+                    const std::vector<std::string_view>& tags,
+                    const SessionOptions& session_options,
+                    const WarmupOptions& warmup)
+    : graph_(TF_NewGraph(), TF_DeleteGraph), export_dir_(filename) {
     auto run_options = Buffer {};
     auto meta_graph = Buffer {};
 
@@ -98,14 +350,161 @@ inline Model::Model(const std::string_view& filename,
     for (const auto& tag : tags) {
         tag_names.emplace_back(tag.data());
     }
-    session_.reset(
-        TF_LoadSessionFromSavedModel(
-            session_options.get(), run_options.get(), filename.data(),
-            tag_names.data(), static_cast<int32_t>(tag_names.size()),
-            graph_.get(), meta_graph.get(), context::get_status()),
-        session_deleter);
+    auto* session = TF_LoadSessionFromSavedModel(
+        session_options.get(), run_options.get(), filename.data(),
+        tag_names.data(), static_cast<int32_t>(tag_names.size()),
+        graph_.get(), meta_graph.get(), context::get_status());
+    // Only hand the session to the deleter once loading succeeded, it
+    // checks the status again
+    status_check(context::get_status());
+    session_.reset(session, session_deleter);
+
+    const auto* meta_graph_def = meta_graph.get();
+    auto signatures = std::make_shared<std::map<std::string, SignatureDef>>(
+        parse_signature_defs({static_cast<const char*>(meta_graph_def->data),
+                              meta_graph_def->length}));
+
+    // Resolve every signature tensor once, so that runs by signature need no
+    // graph lookups. Tensors missing from the graph are left unresolved
+    auto resolve = [this](TensorInfo& info) {
+        auto [op_name, op_index] = parse_name(info.name);
+        info.output.oper
+            = TF_GraphOperationByName(graph_.get(), op_name.c_str());
+        info.output.index = op_index;
+    };
+    for (auto& [key, signature] : *signatures) {
+        for (auto& [name, info] : signature.inputs) {
+            resolve(info);
+        }
+        for (auto& [name, info] : signature.outputs) {
+            resolve(info);
+        }
+    }
+    signatures_ = std::move(signatures);
+
+    this->warmup(warmup);
+}
+
+inline Model Model::from_graph_def(const std::string_view& filename,
+                                   const std::string_view& weights,
+                                   const SessionOptions& session_options) {
+    auto model = from_graph_def(filename, session_options);
+
+    auto bound_inputs = std::make_shared<detail::BoundInputs>();
+    for (auto& [name, tensor] : read_npz(std::filesystem::path {weights})) {
+        auto* oper = TF_GraphOperationByName(model.graph_.get(), name.c_str());
+        if (!oper
+            || std::string_view {TF_OperationOpType(oper)} != "Placeholder") {
+            throw std::runtime_error("The graph has no placeholder named \""
+                                     + name + "\" for its weight");
+        }
+        bound_inputs->outputs.push_back({oper, 0});
+        bound_inputs->values.push_back(tensor.get_tensor().get());
+        bound_inputs->tensors.emplace_back(std::move(tensor));
+    }
+    model.bound_inputs_ = std::move(bound_inputs);
+    return model;
+}
+
+inline Model Model::from_graph_def(const std::string_view& filename,
+                                   const SessionOptions& session_options) {
+    auto file = MappedFile {std::filesystem::path {filename}};
+    auto graph = std::shared_ptr<TF_Graph> {TF_NewGraph(), TF_DeleteGraph};
+
+    // The buffer borrows the mapping, nothing to deallocate
+    auto graph_def = TF_Buffer {file.data(), file.size(), nullptr};
+    auto options = std::unique_ptr<TF_ImportGraphDefOptions,
+                                   decltype(&TF_DeleteImportGraphDefOptions)>(
+        TF_NewImportGraphDefOptions(), TF_DeleteImportGraphDefOptions);
+    TF_GraphImportGraphDef(graph.get(), &graph_def, options.get(),
+                           context::get_status());
+    status_check(context::get_status());
+
+    auto* session = TF_NewSession(graph.get(), session_options.get(),
+                                  context::get_status());
+    status_check(context::get_status());
+
+    auto session_deleter = [](TF_Session* sess) {
+        TF_DeleteSession(sess, context::get_status());
+        status_check(context::get_status());
+    };
+    return Model {std::move(graph),
+                  std::shared_ptr<TF_Session> {session, session_deleter}};
+}
 
+inline FrozenGraph Model::freeze(const std::vector<std::string>& outputs) {
+    auto graph_def = Buffer {};
+    TF_GraphToGraphDef(graph_.get(), graph_def.get(), context::get_status());
     status_check(context::get_status());
+
+    const auto* buffer = graph_def.get();
+    return freeze_graph_def(
+        {static_cast<const char*>(buffer->data), buffer->length}, outputs,
+        [this](const std::vector<std::string>& variables) {
+            auto names = std::vector<std::string> {};
+            for (const auto& variable : variables) {
+                auto* oper = TF_GraphOperationByName(graph_.get(),
+                                                     variable.c_str());
+                if (std::string_view {TF_OperationOpType(oper)}
+                    != "VarHandleOp") {
+                    names.emplace_back(variable + ":0");
+                    continue;
+                }
+
+                // Added once, the session picks up the new nodes
+                auto name = "cppflow_freeze/" + variable;
+                if (!TF_GraphOperationByName(graph_.get(), name.c_str())) {
+                    auto dtype = TF_DataType {};
+                    TF_OperationGetAttrType(oper, "dtype", &dtype,
+                                            context::get_status());
+                    status_check(context::get_status());
+                    auto* description = TF_NewOperation(
+                        graph_.get(), "ReadVariableOp", name.c_str());
+                    TF_AddInput(description, {oper, 0});
+                    TF_SetAttrType(description, "dtype", dtype);
+                    TF_FinishOperation(description, context::get_status());
+                    status_check(context::get_status());
+                }
+                names.emplace_back(name + ":0");
+            }
+            return forward(std::vector<std::tuple<std::string, Tensor>> {},
+                           names);
+        });
+}
+
+inline void Model::warmup(const WarmupOptions& options) {
+    for (const auto& key : options.signatures) {
+        const auto& signature = get_signature(key);
+
+        auto inputs = std::vector<std::tuple<std::string, Tensor>> {};
+        for (const auto& [name, info] : signature.inputs) {
+            inputs.emplace_back(info.name,
+                                synthesize_input(info.name,
+                                                 options.unknown_dim));
+        }
+        auto outputs = std::vector<std::string> {};
+        for (const auto& [name, info] : signature.outputs) {
+            outputs.emplace_back(info.name);
+        }
+
+        for (int i = 0; i < options.iterations; ++i) {
+            forward(inputs, outputs);
+        }
+    }
+
+    if (options.replay_requests) {
+        auto path = std::filesystem::path {export_dir_} / "assets.extra"
+                    / "tf_serving_warmup_requests";
+        if (std::filesystem::exists(path)) {
+            auto requests = read_warmup_requests(path, *signatures_,
+                                                 options.max_replay_requests);
+            for (int i = 0; i < options.replay_iterations; ++i) {
+                for (const auto& request : requests) {
+                    forward(request.inputs, request.outputs);
+                }
+            }
+        }
+    }
 }
 
 inline std::vector<std::string> Model::get_operations() const {
@@ -136,15 +535,21 @@ inline std::vector<int64_t> Model::get_operation_shape(
         throw std::runtime_error("NoOp doesn't have a shape");
     }
 
-    // Get number of dimensions
+    return get_output_shape(out_op);
+}
+
+inline std::vector<int64_t> Model::get_output_shape(
+    const TF_Output& output) const {
+    // Get number of dimensions, -1 if unknown
     auto n_dims
-        = TF_GraphGetTensorNumDims(graph_.get(), out_op, context::get_status());
+        = TF_GraphGetTensorNumDims(graph_.get(), output, context::get_status());
+    status_check(context::get_status());
 
     // If is not a scalar
-    auto shape = std::vector<int64_t>(n_dims);
+    auto shape = std::vector<int64_t>(std::max(n_dims, 0));
     if (n_dims > 0) {
         // Get dimensions
-        TF_GraphGetTensorShape(graph_.get(), out_op, shape.data(), n_dims,
+        TF_GraphGetTensorShape(graph_.get(), output, shape.data(), n_dims,
                                context::get_status());
         // Check error on Model Status
         status_check(context::get_status());
@@ -153,19 +558,156 @@ inline std::vector<int64_t> Model::get_operation_shape(
     return shape;
 }
 
-inline std::tuple<std::string, int32_t> parse_name(
-    const std::string_view& name) {
-    auto pos = name.find(':');
-    if (pos == std::string_view::npos) {
-        return std::make_tuple(std::string {name}, 0);
+inline Tensor Model::synthesize_input(const std::string_view& name,
+                                      int64_t unknown_dim) const {
+    auto output = resolve_output(name);
+    auto type = TF_OperationOutputType(output);
+    auto shape = get_output_shape(output);
+
+    auto count = std::size_t {1};
+    for (auto& dim : shape) {
+        if (dim < 0) {
+            dim = unknown_dim;
+        }
+        count *= static_cast<std::size_t>(dim);
     }
 
-    auto prefix = name.substr(0, pos);
-    auto suffix = name.substr(pos + 1);
-    int32_t index = 0;
-    std::from_chars(suffix.begin(), suffix.end(), index, 10);
+    if (type == TF_STRING) {
+        return Tensor {detail::allocate_string_tensor(shape, count)};
+    }
 
-    return std::make_tuple(std::string {prefix}, index);
+    auto bytes = count * TF_DataTypeSize(type);
+    auto* tensor = TF_AllocateTensor(type, shape.data(),
+                                     static_cast<int>(shape.size()), bytes);
+    std::memset(TF_TensorData(tensor), 0, bytes);
+    return Tensor {tensor};
+}
+
+inline TF_Output Model::resolve_output(const std::string_view& name) const {
+    auto [op_name, op_index] = parse_name(name);
+    auto* op = TF_GraphOperationByName(graph_.get(), op_name.c_str());
+    if (!op) {
+        throw std::runtime_error("No operation named \"" + op_name
+                                 + "\" exists");
+    }
+    return TF_Output {op, op_index};
+}
+
+inline Runner Model::prepare(
+    const std::vector<std::string_view>& inputs,
+    const std::vector<std::string_view>& outputs) const {
+    auto input_ops = std::vector<TF_Output> {};
+    input_ops.reserve(inputs.size());
+    for (const auto& input : inputs) {
+        input_ops.emplace_back(resolve_output(input));
+    }
+
+    auto output_ops = std::vector<TF_Output> {};
+    output_ops.reserve(outputs.size());
+    for (const auto& output : outputs) {
+        output_ops.emplace_back(resolve_output(output));
+    }
+
+    return Runner {graph_, session_, profiler_, bound_inputs_,
+                   std::move(input_ops), std::move(output_ops)};
+}
+
+inline const SignatureDef& Model::get_signature(const std::string& key) const {
+    auto signature = signatures_->find(key);
+    if (signature == signatures_->end()) {
+        throw std::runtime_error("No signature named \"" + key + "\" exists");
+    }
+    return signature->second;
+}
+
+namespace detail {
+
+inline TF_Output signature_output(
+    const std::map<std::string, TensorInfo>& infos, const std::string& name) {
+    auto info = infos.find(name);
+    if (info == infos.end()) {
+        throw std::runtime_error("Signature has no tensor named \"" + name
+                                 + "\"");
+    }
+    if (!info->second.output.oper) {
+        throw std::runtime_error("No operation named \"" + info->second.name
+                                 + "\" exists");
+    }
+    return info->second.output;
+}
+
+}    // namespace detail
+
+inline Runner Model::prepare_signature(
+    const std::string& key, const std::vector<std::string>& inputs,
+    const std::vector<std::string>& outputs) const {
+    const auto& signature = get_signature(key);
+
+    auto input_ops = std::vector<TF_Output> {};
+    input_ops.reserve(inputs.size());
+    for (const auto& input : inputs) {
+        input_ops.emplace_back(
+            detail::signature_output(signature.inputs, input));
+    }
+
+    auto output_ops = std::vector<TF_Output> {};
+    if (outputs.empty()) {
+        output_ops.reserve(signature.outputs.size());
+        for (const auto& [name, info] : signature.outputs) {
+            output_ops.emplace_back(
+                detail::signature_output(signature.outputs, name));
+        }
+    } else {
+        output_ops.reserve(outputs.size());
+        for (const auto& output : outputs) {
+            output_ops.emplace_back(
+                detail::signature_output(signature.outputs, output));
+        }
+    }
+
+    return Runner {graph_, session_, profiler_, bound_inputs_,
+                   std::move(input_ops), std::move(output_ops)};
+}
+
+inline std::map<std::string, Tensor> Model::forward_signature(
+    const std::string& key, const std::map<std::string, Tensor>& inputs) {
+    const auto& signature = get_signature(key);
+
+    auto input_ops = SmallBuffer<TF_Output, Runner::kInlineArgs> {
+        inputs.size()};
+    auto input_values = SmallBuffer<TF_Tensor*, Runner::kInlineArgs> {
+        inputs.size()};
+    auto i = std::size_t {0};
+    for (const auto& [name, tensor] : inputs) {
+        input_ops[i] = detail::signature_output(signature.inputs, name);
+        input_values[i] = tensor.get_tensor().get();
+        ++i;
+    }
+
+    auto output_ops = SmallBuffer<TF_Output, Runner::kInlineArgs> {
+        signature.outputs.size()};
+    auto output_values = SmallBuffer<TF_Tensor*, Runner::kInlineArgs> {
+        signature.outputs.size()};
+    i = 0;
+    for (const auto& [name, info] : signature.outputs) {
+        output_ops[i] = detail::signature_output(signature.outputs, name);
+        output_values[i] = nullptr;
+        ++i;
+    }
+
+    detail::session_run(session_.get(), profiler_.get(), bound_inputs_.get(),
+                        input_ops.data(), input_values.data(),
+                        static_cast<int>(inputs.size()),
+                        output_ops.data(), output_values.data(),
+                        static_cast<int>(output_ops.size()));
+
+    auto result = std::map<std::string, Tensor> {};
+    i = 0;
+    for (const auto& [name, info] : signature.outputs) {
+        result.emplace(name, Tensor {output_values[i++]});
+    }
+
+    return result;
 }
 
 inline std::vector<Tensor> Model::forward(
@@ -174,7 +716,7 @@ inline std::vector<Tensor> Model::forward(
     auto inputs_view = std::vector<std::tuple<std::string_view, Tensor>> {};
     inputs_view.reserve(inputs.size());
     for (const auto& [input, tensor] : inputs) {
-        inputs_view.emplace_back(std::make_tuple(input, tensor));
+        inputs_view.emplace_back(input, tensor);
     }
 
     auto outputs_view = std::vector<std::string_view> {};
@@ -198,13 +740,7 @@ inline std::vector<Tensor> Model::forward(
     input_values.reserve(inputs.size());
 
     for (const auto& [name, tensor] : inputs) {
-        auto [op_name, op_index] = parse_name(name);
-        auto* op = TF_GraphOperationByName(graph_.get(), op_name.c_str());
-        if (!op) {
-            throw std::runtime_error("No operation named \"" + op_name
-                                     + "\" exists");
-        }
-        input_ops.emplace_back(TF_Output {op, op_index});
+        input_ops.emplace_back(resolve_output(name));
         input_values.emplace_back(tensor.get_tensor().get());
     }
 
@@ -213,21 +749,15 @@ inline std::vector<Tensor> Model::forward(
     auto output_values = std::vector<TF_Tensor*> {};
     output_values.reserve(outputs.size());
     for (const auto& output : outputs) {
-        auto [op_name, op_index] = parse_name(output);
-        auto* op = TF_GraphOperationByName(graph_.get(), op_name.c_str());
-        if (!op) {
-            throw std::runtime_error("No operation named \"" + op_name
-                                     + "\" exists");
-        }
-        output_ops.emplace_back(TF_Output {op, op_index});
+        output_ops.emplace_back(resolve_output(output));
         output_values.emplace_back(nullptr);
     }
 
-    TF_SessionRun(session_.get(), nullptr, input_ops.data(),
-                  input_values.data(), inputs.size(), output_ops.data(),
-                  output_values.data(), outputs.size(), nullptr, 0, nullptr,
-                  context::get_status());
-    status_check(context::get_status());
+    detail::session_run(session_.get(), profiler_.get(), bound_inputs_.get(),
+                        input_ops.data(), input_values.data(),
+                        static_cast<int>(inputs.size()),
+                        output_ops.data(), output_values.data(),
+                        static_cast<int>(outputs.size()));
 
     auto output_tensors = std::vector<Tensor> {};
     output_tensors.reserve(output_values.size());
@@ -238,7 +768,58 @@ inline std::vector<Tensor> Model::forward(
     return output_tensors;
 }
 
+inline std::future<std::vector<Tensor>> Model::forward_async(
+    std::vector<std::tuple<std::string, Tensor>> inputs,
+    std::vector<std::string> outputs, Executor& executor) const {
+    return executor.async([model = *this, inputs = std::move(inputs),
+                           outputs = std::move(outputs)]() mutable {
+        return model.forward(inputs, outputs);
+    });
+}
+
+inline std::future<Tensor> Model::forward_async(const Tensor& input,
+                                                Executor& executor) const {
+    return executor.async(
+        [model = *this, input]() mutable { return model.forward(input); });
+}
+
+inline void Model::forward_async(
+    std::vector<std::tuple<std::string, Tensor>> inputs,
+    std::vector<std::string> outputs, ForwardCallback callback,
+    Executor& executor) const {
+    executor.submit([model = *this, inputs = std::move(inputs),
+                     outputs = std::move(outputs),
+                     callback = std::move(callback)]() mutable {
+        auto result = std::vector<Tensor> {};
+        try {
+            result = model.forward(inputs, outputs);
+        } catch (...) {
+            callback({}, std::current_exception());
+            return;
+        }
+        callback(std::move(result), nullptr);
+    });
+}
+
 inline Tensor Model::forward(const Tensor& input) {
+    // Use the single input and output of serving_default when the model has
+    // one, the names exported by Keras otherwise
+    auto signature = signatures_->find("serving_default");
+    if (signature != signatures_->end()
+        && signature->second.inputs.size() == 1
+        && signature->second.outputs.size() == 1) {
+        auto input_op = signature->second.inputs.begin()->second.output;
+        auto output_op = signature->second.outputs.begin()->second.output;
+        if (input_op.oper && output_op.oper) {
+            auto* input_value = input.get_tensor().get();
+            auto* output_value = static_cast<TF_Tensor*>(nullptr);
+            detail::session_run(session_.get(), profiler_.get(),
+                                bound_inputs_.get(), &input_op, &input_value,
+                                1, &output_op, &output_value, 1);
+            return Tensor {output_value};
+        }
+    }
+
     return forward({{"serving_default_inputs:0", input}},
                    {"StatefulPartitionedCall:0"})[0];
 }
@@ -0,0 +1,329 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_MODEL_MANAGER_H__
+#define __CPPFLOW2_MODEL_MANAGER_H__
+
+#include "model.h"
+#include "session_options.h"
+#include "tensor.h"
+#include "warmup.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+
+namespace cppflow {
+
+struct ModelManagerOptions {
+    // Tags of the MetaGraphDef to load
+    std::vector<std::string> tags {"serve"};
+    SessionOptions session_options;
+    // Applied to every version before it goes live
+    WarmupOptions warmup;
+    // How often the base directory is scanned, zero disables the background
+    // thread and versions are only picked up by poll()
+    std::chrono::milliseconds poll_interval {std::chrono::seconds {1}};
+    // Called after every load attempt, with the error if it failed
+    std::function<void(int64_t version, std::exception_ptr error)> on_load;
+};
+
+/**
+ * @class ModelManager
+ * @brief Serves the latest version of a model and reloads it without downtime
+ *
+ * The base directory holds one SavedModel per numeric subdirectory, as in
+ * TensorFlow Serving:
+ *
+ *     base_dir/1/saved_model.pb
+ *     base_dir/2/saved_model.pb
+ *
+ * Newer versions are loaded and warmed up in the background, then swapped
+ * in. Runs already in flight keep the Model they started with; an old
+ * version is released by the manager once nothing uses it anymore, so its
+ * session is never torn down on a request thread. A version that fails to
+ * load, e.g. because it is still being copied, is skipped and the current
+ * one keeps serving. It is tried again once any of its files changes.
+ */
+class ModelManager {
+public:
+    /**
+     * Loads the latest version and starts watching for newer ones
+     * @param base_dir Directory holding the numeric version subdirectories
+     * @throw std::runtime_error if no version can be found
+     */
+    explicit ModelManager(const std::string_view& base_dir,
+                          ModelManagerOptions options = {});
+    ~ModelManager();
+
+    /**
+     * @return The live model. Holding the pointer keeps that version loaded
+     */
+    std::shared_ptr<Model> current() const {
+        auto lock = std::lock_guard {mutex_};
+        return model_;
+    }
+
+    /**
+     * @return The version number of the live model
+     */
+    int64_t version() const {
+        auto lock = std::lock_guard {mutex_};
+        return version_;
+    }
+
+    /**
+     * @return Number of replaced versions still used by in-flight runs,
+     * Model copies or Runners
+     */
+    std::size_t draining() const {
+        auto lock = std::lock_guard {mutex_};
+        return retired_.size();
+    }
+
+    /**
+     * Scans the base directory now, loads the latest version if it is newer
+     * than the live one, and releases drained versions
+     * @return true if a new version went live
+     */
+    bool poll();
+
+    /**
+     * @return The valid versions in a base directory, in ascending order
+     */
+    static std::vector<int64_t> list_versions(
+        const std::filesystem::path& base_dir);
+
+    std::vector<Tensor> forward(
+        const std::vector<std::tuple<std::string, Tensor>>& inputs,
+        const std::vector<std::string>& outputs) {
+        return current()->forward(inputs, outputs);
+    }
+    Tensor forward(const Tensor& input) {
+        return current()->forward(input);
+    }
+
+    std::vector<Tensor> operator()(
+        const std::vector<std::tuple<std::string, Tensor>>& inputs,
+        const std::vector<std::string>& outputs) {
+        return forward(inputs, outputs);
+    }
+    Tensor operator()(const Tensor& input) {
+        return forward(input);
+    }
+
+    ModelManager(const ModelManager&) = delete;
+    ModelManager& operator=(const ModelManager&) = delete;
+
+private:
+    std::shared_ptr<Model> load(int64_t version) const;
+    // Newest modification time of the files of a version
+    std::filesystem::file_time_type last_write(int64_t version) const;
+    void release_drained();
+    void watch();
+
+private:
+    std::filesystem::path base_dir_;
+    ModelManagerOptions options_;
+
+    // Guards the live model and the retired ones
+    mutable std::mutex mutex_;
+    std::shared_ptr<Model> model_;
+    int64_t version_ {-1};
+    std::vector<std::shared_ptr<Model>> retired_;
+
+    // Serialises poll() and remembers the versions that failed to load,
+    // with their last_write() before the attempt
+    std::mutex poll_mutex_;
+    std::map<int64_t, std::filesystem::file_time_type> failed_;
+
+    std::mutex watch_mutex_;
+    std::condition_variable watch_cv_;
+    bool stop_ {false};
+    std::thread watcher_;
+};
+
+}    // namespace cppflow
+
+
+namespace cppflow {
+
+inline ModelManager::ModelManager(const std::string_view& base_dir,
+                                  ModelManagerOptions options)
+    : base_dir_(base_dir), options_(std::move(options)) {
+    auto versions = list_versions(base_dir_);
+    if (versions.empty()) {
+        throw std::runtime_error("No model version found in "
+                                 + base_dir_.string());
+    }
+
+    version_ = versions.back();
+    model_ = load(version_);
+
+    if (options_.poll_interval.count() > 0) {
+        watcher_ = std::thread {[this] { watch(); }};
+    }
+}
+
+inline ModelManager::~ModelManager() {
+    {
+        auto lock = std::lock_guard {watch_mutex_};
+        stop_ = true;
+    }
+    watch_cv_.notify_all();
+    if (watcher_.joinable()) {
+        watcher_.join();
+    }
+}
+
+inline std::vector<int64_t> ModelManager::list_versions(
+    const std::filesystem::path& base_dir) {
+    auto versions = std::vector<int64_t> {};
+
+    auto error = std::error_code {};
+    for (const auto& entry :
+         std::filesystem::directory_iterator {base_dir, error}) {
+        auto name = entry.path().filename().string();
+        if (name.empty() || !entry.is_directory()
+            || !std::all_of(name.begin(), name.end(),
+                            [](char c) { return c >= '0' && c <= '9'; })) {
+            continue;
+        }
+        // Skip versions still being copied in
+        if (!std::filesystem::exists(entry.path() / "saved_model.pb")
+            && !std::filesystem::exists(entry.path() / "saved_model.pbtxt")) {
+            continue;
+        }
+        versions.emplace_back(std::stoll(name));
+    }
+
+    std::sort(versions.begin(), versions.end());
+    return versions;
+}
+
+inline std::shared_ptr<Model> ModelManager::load(int64_t version) const {
+    auto tags = std::vector<std::string_view>(options_.tags.begin(),
+                                              options_.tags.end());
+    auto path = (base_dir_ / std::to_string(version)).string();
+    return std::make_shared<Model>(path, tags, options_.session_options,
+                                   options_.warmup);
+}
+
+inline std::filesystem::file_time_type ModelManager::last_write(
+    int64_t version) const {
+    auto path = base_dir_ / std::to_string(version);
+    auto error = std::error_code {};
+    auto newest = std::filesystem::last_write_time(path, error);
+    // Files may come and go while they are copied, errors are skipped
+    for (auto it = std::filesystem::recursive_directory_iterator {path, error};
+         !error && it != std::filesystem::recursive_directory_iterator {};
+         it.increment(error)) {
+        auto entry_error = std::error_code {};
+        auto time = it->last_write_time(entry_error);
+        if (!entry_error && time > newest) {
+            newest = time;
+        }
+    }
+    return newest;
+}
+
+inline bool ModelManager::poll() {
+    auto poll_lock = std::lock_guard {poll_mutex_};
+    release_drained();
+
+    auto versions = list_versions(base_dir_);
+    auto latest = std::find_if(versions.rbegin(), versions.rend(),
+                               [this](int64_t version) {
+                                   auto failed = failed_.find(version);
+                                   return failed == failed_.end()
+                                          || failed->second
+                                                 != last_write(version);
+                               });
+    if (latest == versions.rend() || *latest <= version()) {
+        return false;
+    }
+
+    // Taken before loading, so that files still being written while the
+    // load fails lead to another attempt
+    auto written = last_write(*latest);
+
+    // Load and warm up outside of mutex_, requests keep flowing meanwhile
+    auto model = std::shared_ptr<Model> {};
+    try {
+        model = load(*latest);
+    } catch (...) {
+        failed_[*latest] = written;
+        if (options_.on_load) {
+            options_.on_load(*latest, std::current_exception());
+        }
+        return false;
+    }
+
+    failed_.erase(*latest);
+    {
+        auto lock = std::lock_guard {mutex_};
+        retired_.emplace_back(std::move(model_));
+        model_ = std::move(model);
+        version_ = *latest;
+    }
+    if (options_.on_load) {
+        options_.on_load(*latest, nullptr);
+    }
+
+    release_drained();
+    return true;
+}
+
+inline void ModelManager::release_drained() {
+    // Drop the drained versions outside of mutex_, tearing down a session
+    // can take a while
+    auto drained = std::vector<std::shared_ptr<Model>> {};
+    {
+        auto lock = std::lock_guard {mutex_};
+        // Asynchronous runs, coroutines and Runners hold copies of the
+        // Model or of its session rather than the shared_ptr. Once both
+        // are only held here, nothing can take a new reference.
+        auto it = std::partition(
+            retired_.begin(), retired_.end(),
+            [](const std::shared_ptr<Model>& model) {
+                return model.use_count() > 1
+                       || model->session_.use_count() > 1;
+            });
+        drained.assign(std::make_move_iterator(it),
+                       std::make_move_iterator(retired_.end()));
+        retired_.erase(it, retired_.end());
+    }
+}
+
+inline void ModelManager::watch() {
+    auto lock = std::unique_lock {watch_mutex_};
+    while (!watch_cv_.wait_for(lock, options_.poll_interval,
+                               [this] { return stop_; })) {
+        lock.unlock();
+        try {
+            poll();
+        } catch (...) {
+            // The directory may be briefly unreadable, try again next time
+        }
+        lock.lock();
+    }
+}
+
+}    // namespace cppflow
+
+#endif
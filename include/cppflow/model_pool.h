@@ -0,0 +1,325 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_MODEL_POOL_H__
+#define __CPPFLOW2_MODEL_POOL_H__
+
+#include "defer.h"
+#include "model.h"
+#include "proto.h"
+#include "session_options.h"
+#include "tensor.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#if defined(__linux__)
+#include <sched.h>
+#endif
+
+
+namespace cppflow {
+
+/**
+ * @class CpuSet
+ * @brief A set of logical CPUs a model replica is placed on
+ *
+ * An empty set means no placement.
+ */
+class CpuSet {
+public:
+    CpuSet() = default;
+    explicit CpuSet(std::vector<int> cpus) : cpus_(std::move(cpus)) {
+    }
+
+    /**
+     * @param first First logical CPU of the range
+     * @param count Number of consecutive CPUs
+     */
+    static CpuSet range(int first, int count);
+
+    /**
+     * Reads the CPUs of a NUMA node from sysfs (Linux only)
+     * @param node Index of the NUMA node
+     */
+    static CpuSet numa_node(int node);
+
+    /**
+     * Parses a kernel cpulist such as "0-3,8-11"
+     */
+    static CpuSet parse(const std::string& cpulist);
+
+    const std::vector<int>& cpus() const {
+        return cpus_;
+    }
+
+    bool empty() const {
+        return cpus_.empty();
+    }
+
+    /**
+     * Restricts the calling thread to this set. Threads it creates
+     * afterwards inherit the placement. Does nothing if the set is empty or
+     * the platform has no affinity support.
+     */
+    void pin_current_thread() const;
+
+private:
+    std::vector<int> cpus_;
+};
+
+/**
+ * @class ModelPool
+ * @brief N independent sessions of the same SavedModel
+ *
+ * Every replica is loaded from a thread pinned to its CpuSet, so the thread
+ * pools TensorFlow creates for the session inherit that placement. When a
+ * replica is pinned, use_per_session_threads is turned on for every
+ * session: otherwise the first session would create TensorFlow's
+ * process-wide pools from its pinned thread, confining all the replicas to
+ * its CPUs. Calls are routed to the replica with the fewest runs in flight.
+ */
+class ModelPool {
+public:
+    /**
+     * Loads one replica per placement
+     * @param filename Path of the SavedModel
+     * @param placements CPUs of every replica, empty sets are not pinned
+     * @param tags Tags of the MetaGraphDef to load
+     * @param session_options Options shared by all the sessions. If a
+     * placement is not empty, they must not be adopted from a handle, as
+     * use_per_session_threads is added to their configuration
+     */
+    ModelPool(const std::string_view& filename,
+              const std::vector<CpuSet>& placements,
+              const std::vector<std::string_view>& tags = {"serve"},
+              const SessionOptions& session_options = SessionOptions {});
+
+    /**
+     * Loads `replicas` unpinned replicas
+     */
+    ModelPool(const std::string_view& filename, std::size_t replicas,
+              const std::vector<std::string_view>& tags = {"serve"},
+              const SessionOptions& session_options = SessionOptions {})
+        : ModelPool(filename, std::vector<CpuSet>(replicas), tags,
+                    session_options) {
+    }
+
+    /**
+     * Calls `func(Model&)` on the least-loaded replica
+     */
+    template<typename Func>
+    decltype(auto) with_replica(Func&& func) {
+        auto& replica = acquire();
+        auto release = defer {[&replica] {
+            replica.in_flight.fetch_sub(1, std::memory_order_relaxed);
+        }};
+        return func(replica.model);
+    }
+
+    std::vector<Tensor> forward(
+        const std::vector<std::tuple<std::string, Tensor>>& inputs,
+        const std::vector<std::string>& outputs) {
+        return with_replica(
+            [&](Model& model) { return model.forward(inputs, outputs); });
+    }
+    Tensor forward(const Tensor& input) {
+        return with_replica(
+            [&](Model& model) { return model.forward(input); });
+    }
+
+    std::vector<Tensor> operator()(
+        const std::vector<std::tuple<std::string, Tensor>>& inputs,
+        const std::vector<std::string>& outputs) {
+        return forward(inputs, outputs);
+    }
+    Tensor operator()(const Tensor& input) {
+        return forward(input);
+    }
+
+    std::size_t size() const {
+        return replicas_.size();
+    }
+
+    Model& replica(std::size_t index) {
+        return replicas_.at(index)->model;
+    }
+
+    const CpuSet& placement(std::size_t index) const {
+        return replicas_.at(index)->placement;
+    }
+
+    /**
+     * @return Number of runs currently in flight on a replica
+     */
+    std::size_t in_flight(std::size_t index) const {
+        return replicas_.at(index)->in_flight.load(std::memory_order_relaxed);
+    }
+
+    ModelPool(const ModelPool&) = delete;
+    ModelPool& operator=(const ModelPool&) = delete;
+
+private:
+    struct Replica;
+
+    Replica& acquire();
+
+private:
+    struct Replica {
+        Model model;
+        CpuSet placement;
+        std::atomic<std::size_t> in_flight {0};
+    };
+
+    std::vector<std::unique_ptr<Replica>> replicas_;
+    std::atomic<std::size_t> next_ {0};
+};
+
+}    // namespace cppflow
+
+
+namespace cppflow {
+
+inline CpuSet CpuSet::range(int first, int count) {
+    auto cpus = std::vector<int>(count);
+    for (int i = 0; i < count; ++i) {
+        cpus[i] = first + i;
+    }
+    return CpuSet {std::move(cpus)};
+}
+
+inline CpuSet CpuSet::parse(const std::string& cpulist) {
+    auto cpus = std::vector<int> {};
+    auto stream = std::istringstream {cpulist};
+    auto item = std::string {};
+    while (std::getline(stream, item, ',')) {
+        if (item.empty() || item == "\n") {
+            continue;
+        }
+        auto dash = item.find('-');
+        auto first = std::stoi(item.substr(0, dash));
+        auto last = dash == std::string::npos
+                        ? first
+                        : std::stoi(item.substr(dash + 1));
+        for (int cpu = first; cpu <= last; ++cpu) {
+            cpus.emplace_back(cpu);
+        }
+    }
+    return CpuSet {std::move(cpus)};
+}
+
+inline CpuSet CpuSet::numa_node(int node) {
+    auto path = "/sys/devices/system/node/node" + std::to_string(node)
+                + "/cpulist";
+    auto file = std::ifstream {path};
+    if (!file) {
+        throw std::runtime_error("Could not read the CPUs of NUMA node "
+                                 + std::to_string(node));
+    }
+    auto cpulist = std::string {};
+    std::getline(file, cpulist);
+    return parse(cpulist);
+}
+
+inline void CpuSet::pin_current_thread() const {
+    if (cpus_.empty()) {
+        return;
+    }
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : cpus_) {
+        CPU_SET(cpu, &set);
+    }
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        throw std::runtime_error("Could not set the CPU affinity of a thread");
+    }
+#endif
+}
+
+namespace detail {
+
+// The same options with use_per_session_threads on. A field appended to a
+// serialized message overrides an earlier occurrence.
+inline SessionOptions per_session_threads(const SessionOptions& options) {
+    if (!options.config()) {
+        throw std::runtime_error(
+            "Pinned replicas cannot use SessionOptions adopted from a "
+            "handle, as use_per_session_threads must be set");
+    }
+    auto pinned = SessionOptions {};
+    pinned.set_config(*options.config()
+                      + ProtoWriter {}.write_bool(9, true).str());
+    return pinned;
+}
+
+}    // namespace detail
+
+inline ModelPool::ModelPool(const std::string_view& filename,
+                            const std::vector<CpuSet>& placements,
+                            const std::vector<std::string_view>& tags,
+                            const SessionOptions& session_options) {
+    if (placements.empty()) {
+        throw std::runtime_error("A ModelPool needs at least one replica");
+    }
+
+    auto options = session_options;
+    if (std::any_of(placements.begin(), placements.end(),
+                    [](const CpuSet& cpus) { return !cpus.empty(); })) {
+        options = detail::per_session_threads(session_options);
+    }
+
+    // Load every replica from its own pinned thread, all in parallel
+    replicas_.resize(placements.size());
+    auto errors = std::vector<std::exception_ptr>(placements.size());
+    auto loaders = std::vector<std::thread> {};
+    loaders.reserve(placements.size());
+    for (std::size_t i = 0; i < placements.size(); ++i) {
+        loaders.emplace_back([&, i] {
+            try {
+                placements[i].pin_current_thread();
+                replicas_[i].reset(new Replica {
+                    Model {filename, tags, options}, placements[i]});
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+    for (auto& loader : loaders) {
+        loader.join();
+    }
+    for (auto& error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+inline ModelPool::Replica& ModelPool::acquire() {
+    // Start scanning at a rotating offset so ties are spread evenly
+    auto start = next_.fetch_add(1, std::memory_order_relaxed);
+    auto* best = replicas_[start % replicas_.size()].get();
+    for (std::size_t i = 1; i < replicas_.size(); ++i) {
+        auto* candidate = replicas_[(start + i) % replicas_.size()].get();
+        if (candidate->in_flight.load(std::memory_order_relaxed)
+            < best->in_flight.load(std::memory_order_relaxed)) {
+            best = candidate;
+        }
+    }
+    best->in_flight.fetch_add(1, std::memory_order_relaxed);
+    return *best;
+}
+
+}    // namespace cppflow
+
+#endif
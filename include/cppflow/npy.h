@@ -0,0 +1,635 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_NPY_H__
+#define __CPPFLOW2_NPY_H__
+
+#include "aligned_allocator.h"
+#include "mapped_file.h"
+#include "proto.h"
+#include "tensor.h"
+
+#include <tensorflow/c/tf_tensor.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace cppflow {
+
+/**
+ * Reads a NumPy .npy file. The file is memory-mapped and, when its data is
+ * aligned to kTensorAlignment bytes as NumPy and write_npy() lay it out,
+ * the tensor uses the mapped pages directly: nothing is read until it is
+ * accessed and the page cache is shared with other processes. The mapping
+ * is private, so writing to the tensor never changes the file. Otherwise,
+ * and for byte orders other than the host's, the data is copied.
+ * @param filename The .npy file
+ * @return The tensor, of the matching dtype and shape
+ * @throw std::runtime_error if the file is malformed, or holds a dtype
+ * without a TensorFlow equivalent or a Fortran-ordered array
+ */
+inline Tensor read_npy(const std::filesystem::path& filename);
+
+/**
+ * Writes a tensor as a NumPy .npy file with its data aligned to
+ * kTensorAlignment bytes, so read_npy() can map it without copying.
+ * @throw std::runtime_error for string and bfloat16 tensors, which NumPy
+ * has no dtype for, or if the file cannot be written
+ */
+inline void write_npy(const std::filesystem::path& filename,
+                      const Tensor& tensor);
+
+/**
+ * Reads the arrays of a NumPy .npz archive as written by numpy.savez.
+ * Entries are mapped like in read_npy(), and those written by write_npz()
+ * are aligned for zero-copy use. Checksums are not verified, as that would
+ * read every page.
+ * @return The tensors by name, without the ".npy" suffix
+ * @throw std::runtime_error if the archive is malformed or compressed, as
+ * by numpy.savez_compressed
+ */
+inline std::map<std::string, Tensor> read_npz(
+    const std::filesystem::path& filename);
+
+/**
+ * Writes tensors as an uncompressed NumPy .npz archive, each stored as
+ * "<name>.npy" with its data aligned to kTensorAlignment bytes.
+ * @throw std::runtime_error like write_npy()
+ */
+inline void write_npz(const std::filesystem::path& filename,
+                      const std::map<std::string, Tensor>& tensors);
+
+}    // namespace cppflow
+
+
+namespace cppflow {
+
+namespace detail {
+
+struct NpyType {
+    char kind;
+    std::size_t size;
+    TF_DataType dtype;
+};
+
+// NumPy type codes, as in '<f4', and their TensorFlow equivalents
+inline constexpr std::array<NpyType, 14> npy_types {{
+    {'b', 1, TF_BOOL},
+    {'i', 1, TF_INT8},
+    {'i', 2, TF_INT16},
+    {'i', 4, TF_INT32},
+    {'i', 8, TF_INT64},
+    {'u', 1, TF_UINT8},
+    {'u', 2, TF_UINT16},
+    {'u', 4, TF_UINT32},
+    {'u', 8, TF_UINT64},
+    {'f', 2, TF_HALF},
+    {'f', 4, TF_FLOAT},
+    {'f', 8, TF_DOUBLE},
+    {'c', 8, TF_COMPLEX64},
+    {'c', 16, TF_COMPLEX128},
+}};
+
+inline constexpr std::string_view npy_magic {"\x93NUMPY", 6};
+
+struct NpyArray {
+    TF_DataType dtype {TF_FLOAT};
+    std::vector<int64_t> shape;
+    std::size_t item_size {0};
+    bool byteswap {false};
+    std::string_view data;
+};
+
+inline void append_le(std::string& out, uint64_t value, std::size_t bytes) {
+    for (std::size_t i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+inline std::string_view trim(std::string_view text) {
+    auto begin = text.find_first_not_of(" \t\n");
+    if (begin == std::string_view::npos) {
+        return {};
+    }
+    auto end = text.find_last_not_of(" \t\n");
+    return text.substr(begin, end - begin + 1);
+}
+
+// The value of `key` in the header's Python dict literal
+inline std::string_view npy_header_value(std::string_view header,
+                                         std::string_view key) {
+    for (auto quote : {'\'', '"'}) {
+        auto quoted = std::string {quote} + std::string {key} + quote;
+        auto pos = header.find(quoted);
+        if (pos == std::string_view::npos) {
+            continue;
+        }
+        pos = header.find(':', pos + quoted.size());
+        if (pos == std::string_view::npos) {
+            break;
+        }
+        auto depth = 0;
+        for (auto end = pos + 1; end < header.size(); ++end) {
+            auto c = header[end];
+            if (c == '(') {
+                ++depth;
+            } else if (c == ')') {
+                --depth;
+            } else if (depth == 0 && (c == ',' || c == '}')) {
+                return trim(header.substr(pos + 1, end - pos - 1));
+            }
+        }
+        break;
+    }
+    throw std::runtime_error("The .npy header has no valid '"
+                             + std::string {key} + "' entry");
+}
+
+inline NpyArray parse_npy(std::string_view bytes) {
+    if (bytes.size() < 10 || bytes.substr(0, 6) != npy_magic) {
+        throw std::runtime_error("Not a .npy file");
+    }
+    auto major = static_cast<unsigned char>(bytes[6]);
+    if (major < 1 || major > 3) {
+        throw std::runtime_error("Unsupported .npy version "
+                                 + std::to_string(major));
+    }
+    auto prefix = std::size_t {major == 1 ? 10u : 12u};
+    if (bytes.size() < prefix) {
+        throw std::runtime_error("Truncated .npy header");
+    }
+    auto header_size = read_le(bytes.data() + 8, prefix - 8);
+    if (header_size > bytes.size() - prefix) {
+        throw std::runtime_error("Truncated .npy header");
+    }
+    auto header = bytes.substr(prefix, header_size);
+
+    auto array = NpyArray {};
+    auto descr = npy_header_value(header, "descr");
+    if (descr.size() < 4 || (descr.front() != '\'' && descr.front() != '"')
+        || descr.back() != descr.front()) {
+        throw std::runtime_error("Unsupported .npy dtype "
+                                 + std::string {descr});
+    }
+    descr = descr.substr(1, descr.size() - 2);
+    auto order = descr[0];
+    auto kind = descr[1];
+    auto size = std::size_t {0};
+    auto [end, error] = std::from_chars(descr.data() + 2,
+                                        descr.data() + descr.size(), size);
+    auto type = std::find_if(
+        npy_types.begin(), npy_types.end(),
+        [&](const NpyType& t) { return t.kind == kind && t.size == size; });
+    if (error != std::errc {} || end != descr.data() + descr.size()
+        || type == npy_types.end()
+        || (order != '<' && order != '>' && order != '|' && order != '=')) {
+        throw std::runtime_error("Unsupported .npy dtype "
+                                 + std::string {descr});
+    }
+    array.dtype = type->dtype;
+    array.item_size = size;
+    auto little = std::endian::native == std::endian::little;
+    array.byteswap = size > 1
+                     && ((order == '<' && !little) || (order == '>' && little));
+
+    auto shape = npy_header_value(header, "shape");
+    if (shape.size() < 2 || shape.front() != '(' || shape.back() != ')') {
+        throw std::runtime_error("Invalid .npy shape " + std::string {shape});
+    }
+    shape = shape.substr(1, shape.size() - 2);
+    auto count = std::size_t {1};
+    while (!trim(shape).empty()) {
+        auto comma = shape.find(',');
+        auto dim_text = trim(shape.substr(0, comma));
+        auto dim = int64_t {0};
+        auto [dim_end, dim_error] = std::from_chars(
+            dim_text.data(), dim_text.data() + dim_text.size(), dim);
+        // Python 2 wrote long integers with an L suffix
+        if (dim_error != std::errc {} || dim < 0
+            || (dim_end != dim_text.data() + dim_text.size()
+                && std::string_view {dim_end, 1} != "L")) {
+            throw std::runtime_error("Invalid .npy dimension "
+                                     + std::string {dim_text});
+        }
+        array.shape.push_back(dim);
+        count *= static_cast<std::size_t>(dim);
+        shape = comma == std::string_view::npos ? std::string_view {}
+                                                : shape.substr(comma + 1);
+    }
+
+    if (npy_header_value(header, "fortran_order") != "False"
+        && array.shape.size() > 1) {
+        throw std::runtime_error("Fortran-ordered .npy arrays are not "
+                                 "supported");
+    }
+
+    auto data = bytes.substr(prefix + header_size);
+    if (data.size() < count * size) {
+        throw std::runtime_error("The .npy data is truncated");
+    }
+    array.data = data.substr(0, count * size);
+    return array;
+}
+
+// Wraps the mapped data if it can be used as it is, copies it otherwise
+inline Tensor npy_tensor(const NpyArray& array, const MappedFile& file) {
+    const auto& shape = array.shape;
+    auto* data = const_cast<char*>(array.data.data());
+    if (!array.byteswap && is_tensor_aligned(data)) {
+        auto* owner = new MappedFile {file};
+        auto* tensor = TF_NewTensor(
+            array.dtype, shape.data(), static_cast<int>(shape.size()), data,
+            array.data.size(),
+            [](void*, size_t, void* arg) {
+                delete static_cast<MappedFile*>(arg);
+            },
+            owner);
+        return Tensor {tensor};
+    }
+
+    auto* tensor = TF_AllocateTensor(array.dtype, shape.data(),
+                                     static_cast<int>(shape.size()),
+                                     array.data.size());
+    auto* out = static_cast<char*>(TF_TensorData(tensor));
+    std::memcpy(out, data, array.data.size());
+    if (array.byteswap) {
+        // Complex numbers swap their real and imaginary parts separately
+        auto word = array.dtype == TF_COMPLEX64 || array.dtype == TF_COMPLEX128
+                        ? array.item_size / 2
+                        : array.item_size;
+        for (std::size_t i = 0; i < array.data.size(); i += word) {
+            std::reverse(out + i, out + i + word);
+        }
+    }
+    return Tensor {tensor};
+}
+
+// The header of `tensor` as .npy, padded so that `offset` plus the header
+// is a multiple of kTensorAlignment
+inline std::string npy_header(const Tensor& tensor, std::size_t offset = 0) {
+    auto dtype = tensor.dtype();
+    auto type
+        = std::find_if(npy_types.begin(), npy_types.end(),
+                       [&](const NpyType& t) { return t.dtype == dtype; });
+    if (type == npy_types.end()) {
+        throw std::runtime_error("Cannot save " + to_string(dtype)
+                                 + " tensors as .npy");
+    }
+
+    auto little = std::endian::native == std::endian::little;
+    auto dict = std::string {"{'descr': '"};
+    dict += type->size == 1 ? '|' : little ? '<' : '>';
+    dict += type->kind + std::to_string(type->size);
+    dict += "', 'fortran_order': False, 'shape': (";
+    auto dims = tensor.dims();
+    for (auto dim : dims) {
+        dict += std::to_string(dim) + ", ";
+    }
+    if (dims.size() > 1) {
+        dict.resize(dict.size() - 2);
+    } else if (dims.size() == 1) {
+        dict.pop_back();
+    }
+    dict += "), }";
+
+    // Version 1.0 stores the header size in 16 bits, 2.0 in 32 bits
+    auto prefix
+        = std::size_t {dict.size() + kTensorAlignment < 65536 ? 10u : 12u};
+    auto total = offset + prefix + dict.size() + 1;
+    dict.append((kTensorAlignment - total % kTensorAlignment)
+                    % kTensorAlignment,
+                ' ');
+    dict += '\n';
+
+    auto header = std::string {npy_magic};
+    header += static_cast<char>(prefix == 10 ? 1 : 2);
+    header += '\0';
+    append_le(header, dict.size(), prefix - 8);
+    return header + dict;
+}
+
+inline std::string_view tensor_bytes(const std::shared_ptr<TF_Tensor>& t) {
+    return {static_cast<const char*>(TF_TensorData(t.get())),
+            TF_TensorByteSize(t.get())};
+}
+
+inline uint32_t crc32(uint32_t crc, std::string_view bytes) {
+    static const auto table = []() {
+        auto entries = std::array<uint32_t, 256> {};
+        for (uint32_t i = 0; i < 256; ++i) {
+            auto value = i;
+            for (auto bit = 0; bit < 8; ++bit) {
+                value = (value & 1u) ? 0xedb88320u ^ (value >> 1) : value >> 1;
+            }
+            entries[i] = value;
+        }
+        return entries;
+    }();
+    crc = ~crc;
+    for (auto byte : bytes) {
+        crc = table[(crc ^ static_cast<unsigned char>(byte)) & 0xffu]
+              ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Zip record signatures and limits, from the PKWARE APPNOTE
+inline constexpr uint32_t kZipLocalHeader = 0x04034b50;
+inline constexpr uint32_t kZipCentralHeader = 0x02014b50;
+inline constexpr uint32_t kZipEnd = 0x06054b50;
+inline constexpr uint32_t kZip64End = 0x06064b50;
+inline constexpr uint32_t kZip64Locator = 0x07064b50;
+inline constexpr uint64_t kZip32Max = 0xffffffff;
+// The extra field id zipalign pads local headers with
+inline constexpr uint16_t kZipPadding = 0xd935;
+
+}    // namespace detail
+
+inline Tensor read_npy(const std::filesystem::path& filename) {
+    auto file = MappedFile {filename, true};
+    return detail::npy_tensor(detail::parse_npy(file.view()), file);
+}
+
+inline void write_npy(const std::filesystem::path& filename,
+                      const Tensor& tensor) {
+    auto header = detail::npy_header(tensor);
+    auto data = detail::tensor_bytes(tensor.get_tensor());
+    auto out = std::ofstream {filename, std::ios::binary};
+    if (!out) {
+        throw std::runtime_error("Could not open " + filename.string());
+    }
+    out.write(header.data(), static_cast<std::streamsize>(header.size()));
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!out.flush()) {
+        throw std::runtime_error("Could not write " + filename.string());
+    }
+}
+
+inline std::map<std::string, Tensor> read_npz(
+    const std::filesystem::path& filename) {
+    auto file = MappedFile {filename, true};
+    auto bytes = file.view();
+    auto corrupt = [&]() {
+        return std::runtime_error(filename.string()
+                                  + " is not a valid .npz archive");
+    };
+    auto at = [&](uint64_t offset, uint64_t size) {
+        if (offset > bytes.size() || size > bytes.size() - offset) {
+            throw corrupt();
+        }
+        return bytes.data() + offset;
+    };
+    auto le = [](const char* data, std::size_t bytes) {
+        return detail::read_le(data, bytes);
+    };
+
+    // The end of central directory record precedes a comment of up to 64KiB
+    if (bytes.size() < 22) {
+        throw corrupt();
+    }
+    auto end = bytes.size() - 22;
+    auto lowest = end > 65535 ? end - 65535 : 0;
+    while (le(bytes.data() + end, 4) != detail::kZipEnd) {
+        if (end == lowest) {
+            throw corrupt();
+        }
+        --end;
+    }
+    auto* record = bytes.data() + end;
+    auto entries = le(record + 10, 2);
+    auto directory = le(record + 16, 4);
+    if ((entries == 0xffff || directory == detail::kZip32Max) && end >= 20
+        && le(record - 20, 4) == detail::kZip64Locator) {
+        auto* zip64 = at(le(record - 12, 8), 56);
+        if (le(zip64, 4) != detail::kZip64End) {
+            throw corrupt();
+        }
+        entries = le(zip64 + 32, 8);
+        directory = le(zip64 + 48, 8);
+    }
+
+    auto tensors = std::map<std::string, Tensor> {};
+    for (uint64_t i = 0; i < entries; ++i) {
+        auto* header = at(directory, 46);
+        if (le(header, 4) != detail::kZipCentralHeader) {
+            throw corrupt();
+        }
+        auto flags = le(header + 8, 2);
+        auto method = le(header + 10, 2);
+        auto size = le(header + 20, 4);
+        auto name_size = le(header + 28, 2);
+        auto extra_size = le(header + 30, 2);
+        auto comment_size = le(header + 32, 2);
+        auto offset = le(header + 42, 4);
+        auto name = std::string {at(directory + 46, name_size), name_size};
+
+        // Zip64 sizes and offsets replace the saturated 32-bit fields
+        auto* extra = at(directory + 46 + name_size, extra_size);
+        for (std::size_t pos = 0; pos + 4 <= extra_size;) {
+            auto id = le(extra + pos, 2);
+            auto length = le(extra + pos + 2, 2);
+            if (id == 1) {
+                auto field = pos + 4;
+                auto next = [&]() {
+                    if (field + 8 > pos + 4 + length
+                        || field + 8 > extra_size) {
+                        throw corrupt();
+                    }
+                    field += 8;
+                    return le(extra + field - 8, 8);
+                };
+                if (size == detail::kZip32Max) {
+                    size = next();
+                }
+                if (le(header + 24, 4) == detail::kZip32Max) {
+                    next();
+                }
+                if (offset == detail::kZip32Max) {
+                    offset = next();
+                }
+            }
+            pos += 4 + length;
+        }
+
+        if (method != 0 || (flags & 1)) {
+            throw std::runtime_error(
+                "Entry \"" + name + "\" of " + filename.string()
+                + " is compressed or encrypted; only archives written by "
+                  "numpy.savez are supported");
+        }
+
+        auto* local = at(offset, 30);
+        if (le(local, 4) != detail::kZipLocalHeader) {
+            throw corrupt();
+        }
+        auto data = offset + 30 + le(local + 26, 2) + le(local + 28, 2);
+        auto array = detail::parse_npy({at(data, size), size});
+
+        if (name.size() > 4 && name.ends_with(".npy")) {
+            name.resize(name.size() - 4);
+        }
+        tensors.insert_or_assign(std::move(name),
+                                 detail::npy_tensor(array, file));
+        directory += 46 + name_size + extra_size + comment_size;
+    }
+    return tensors;
+}
+
+inline void write_npz(const std::filesystem::path& filename,
+                      const std::map<std::string, Tensor>& tensors) {
+    auto out = std::ofstream {filename, std::ios::binary};
+    if (!out) {
+        throw std::runtime_error("Could not open " + filename.string());
+    }
+    auto write = [&](std::string_view bytes) {
+        out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    };
+
+    // Stored entries dated 1980-01-01, the earliest zip date, like numpy
+    constexpr auto version = uint64_t {45};
+    constexpr auto date = uint64_t {0x21};
+    auto directory = std::string {};
+    auto offset = uint64_t {0};
+    for (const auto& [key, tensor] : tensors) {
+        auto name = key + ".npy";
+        auto tf_tensor = tensor.get_tensor();
+        auto data = detail::tensor_bytes(tf_tensor);
+
+        // The header is padded for the data offset, which depends on the
+        // zip64 field; .npy headers are far below 64KiB, so the data size
+        // alone decides whether that field is needed
+        auto large = data.size() >= detail::kZip32Max - 65536;
+        auto large_offset = offset >= detail::kZip32Max;
+        auto prefix = offset + 30 + name.size() + (large ? 20 : 0);
+        auto padding = (kTensorAlignment - prefix % kTensorAlignment)
+                       % kTensorAlignment;
+        if (padding > 0 && padding < 4) {
+            padding += kTensorAlignment;
+        }
+        auto header = detail::npy_header(tensor, prefix + padding);
+        auto size = uint64_t {header.size() + data.size()};
+        auto crc = detail::crc32(detail::crc32(0, header), data);
+
+        auto extra = std::string {};
+        if (large) {
+            detail::append_le(extra, 1, 2);
+            detail::append_le(extra, 16, 2);
+            detail::append_le(extra, size, 8);
+            detail::append_le(extra, size, 8);
+        }
+        if (padding > 0) {
+            detail::append_le(extra, detail::kZipPadding, 2);
+            detail::append_le(extra, padding - 4, 2);
+            extra.append(padding - 4, '\0');
+        }
+
+        auto local = std::string {};
+        detail::append_le(local, detail::kZipLocalHeader, 4);
+        detail::append_le(local, version, 2);
+        detail::append_le(local, 0, 2);    // flags
+        detail::append_le(local, 0, 2);    // stored
+        detail::append_le(local, 0, 2);    // time
+        detail::append_le(local, date, 2);
+        detail::append_le(local, crc, 4);
+        detail::append_le(local, large ? detail::kZip32Max : size, 4);
+        detail::append_le(local, large ? detail::kZip32Max : size, 4);
+        detail::append_le(local, name.size(), 2);
+        detail::append_le(local, extra.size(), 2);
+        write(local);
+        write(name);
+        write(extra);
+        write(header);
+        write(data);
+
+        auto central_extra = std::string {};
+        if (large || large_offset) {
+            detail::append_le(central_extra, 1, 2);
+            detail::append_le(central_extra,
+                              (large ? 16 : 0) + (large_offset ? 8 : 0), 2);
+            if (large) {
+                detail::append_le(central_extra, size, 8);
+                detail::append_le(central_extra, size, 8);
+            }
+            if (large_offset) {
+                detail::append_le(central_extra, offset, 8);
+            }
+        }
+        detail::append_le(directory, detail::kZipCentralHeader, 4);
+        detail::append_le(directory, version, 2);    // made by
+        detail::append_le(directory, version, 2);    // needed
+        detail::append_le(directory, 0, 2);
+        detail::append_le(directory, 0, 2);
+        detail::append_le(directory, 0, 2);
+        detail::append_le(directory, date, 2);
+        detail::append_le(directory, crc, 4);
+        detail::append_le(directory, large ? detail::kZip32Max : size, 4);
+        detail::append_le(directory, large ? detail::kZip32Max : size, 4);
+        detail::append_le(directory, name.size(), 2);
+        detail::append_le(directory, central_extra.size(), 2);
+        detail::append_le(directory, 0, 2);    // comment
+        detail::append_le(directory, 0, 2);    // disk
+        detail::append_le(directory, 0, 2);    // internal attributes
+        detail::append_le(directory, 0, 4);    // external attributes
+        detail::append_le(directory,
+                          large_offset ? detail::kZip32Max : offset, 4);
+        directory += name;
+        directory += central_extra;
+
+        offset += local.size() + name.size() + extra.size() + size;
+    }
+    write(directory);
+
+    auto entries = static_cast<uint64_t>(tensors.size());
+    auto end = std::string {};
+    if (entries >= 0xffff || offset >= detail::kZip32Max
+        || directory.size() >= detail::kZip32Max) {
+        auto zip64 = offset + directory.size();
+        detail::append_le(end, detail::kZip64End, 4);
+        detail::append_le(end, 44, 8);    // size of the rest of the record
+        detail::append_le(end, version, 2);
+        detail::append_le(end, version, 2);
+        detail::append_le(end, 0, 4);
+        detail::append_le(end, 0, 4);
+        detail::append_le(end, entries, 8);
+        detail::append_le(end, entries, 8);
+        detail::append_le(end, directory.size(), 8);
+        detail::append_le(end, offset, 8);
+        detail::append_le(end, detail::kZip64Locator, 4);
+        detail::append_le(end, 0, 4);
+        detail::append_le(end, zip64, 8);
+        detail::append_le(end, 1, 4);    // number of disks
+    }
+    detail::append_le(end, detail::kZipEnd, 4);
+    detail::append_le(end, 0, 2);
+    detail::append_le(end, 0, 2);
+    detail::append_le(end, std::min<uint64_t>(entries, 0xffff), 2);
+    detail::append_le(end, std::min<uint64_t>(entries, 0xffff), 2);
+    detail::append_le(end,
+                      std::min<uint64_t>(directory.size(), detail::kZip32Max),
+                      4);
+    detail::append_le(end, std::min<uint64_t>(offset, detail::kZip32Max), 4);
+    detail::append_le(end, 0, 2);    // comment
+    write(end);
+
+    if (!out.flush()) {
+        throw std::runtime_error("Could not write " + filename.string());
+    }
+}
+
+}    // namespace cppflow
+
+#endif
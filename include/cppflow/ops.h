@@ -5,37 +5,133 @@
 #ifndef CPPFLOW2_OPS_H
 #define CPPFLOW2_OPS_H
 
+#include "host_math.h"
 #include "raw_ops.h"
 #include "tensor.h"
 
+#include <cstdint>
+#include <vector>
+
 
 namespace cppflow {
 
+// The arithmetic operators and reductions compute small host tensors
+// directly, see HostMathOptions, and run the TensorFlow op otherwise
+
 inline Tensor operator+(const Tensor& x, const Tensor& y) {
+    if (auto result = detail::host_binary(detail::HostBinaryOp::kAdd, x, y)) {
+        return *result;
+    }
     return ops::Add(x, y);
 }
 
 inline Tensor operator-(const Tensor& x, const Tensor& y) {
+    if (auto result = detail::host_binary(detail::HostBinaryOp::kSub, x, y)) {
+        return *result;
+    }
     return ops::Sub(x, y);
 }
 
 inline Tensor operator*(const Tensor& x, const Tensor& y) {
+    if (auto result = detail::host_binary(detail::HostBinaryOp::kMul, x, y)) {
+        return *result;
+    }
     return ops::Mul(x, y);
 }
 
 inline Tensor operator/(const Tensor& x, const Tensor& y) {
+    if (auto result = detail::host_binary(detail::HostBinaryOp::kDiv, x, y)) {
+        return *result;
+    }
     return ops::Div(x, y);
 }
 
+namespace detail {
+
+inline Tensor reduction_axes(const Tensor& input,
+                             const std::vector<int64_t>& axes) {
+    if (!axes.empty()) {
+        return Tensor {axes, {static_cast<int64_t>(axes.size())}};
+    }
+    auto rank = static_cast<int64_t>(input.dims().rank());
+    auto all = std::vector<int64_t>(static_cast<std::size_t>(rank));
+    for (int64_t i = 0; i < rank; ++i) {
+        all[static_cast<std::size_t>(i)] = i;
+    }
+    return Tensor {all, {rank}};
+}
+
+}    // namespace detail
+
+/**
+ * Sums the elements along `axes`
+ * @param input The tensor to reduce
+ * @param axes The dimensions to reduce, negative ones count from the end,
+ * all of them if empty
+ * @param keep_dims Keep the reduced dimensions with size 1
+ */
+inline Tensor reduce_sum(const Tensor& input,
+                         const std::vector<int64_t>& axes = {},
+                         bool keep_dims = false) {
+    if (auto result = detail::host_reduce(detail::HostReduceOp::kSum, input,
+                                          axes, keep_dims)) {
+        return *result;
+    }
+    return ops::Sum(input, detail::reduction_axes(input, axes), keep_dims,
+                    TF_INT64);
+}
+
+/**
+ * Averages the elements along `axes`, like reduce_sum()
+ */
+inline Tensor reduce_mean(const Tensor& input,
+                          const std::vector<int64_t>& axes = {},
+                          bool keep_dims = false) {
+    if (auto result = detail::host_reduce(detail::HostReduceOp::kMean, input,
+                                          axes, keep_dims)) {
+        return *result;
+    }
+    return ops::Mean(input, detail::reduction_axes(input, axes), keep_dims,
+                     TF_INT64);
+}
+
+/**
+ * Takes the largest element along `axes`, like reduce_sum()
+ */
+inline Tensor reduce_max(const Tensor& input,
+                         const std::vector<int64_t>& axes = {},
+                         bool keep_dims = false) {
+    if (auto result = detail::host_reduce(detail::HostReduceOp::kMax, input,
+                                          axes, keep_dims)) {
+        return *result;
+    }
+    return ops::Max(input, detail::reduction_axes(input, axes), keep_dims,
+                    TF_INT64);
+}
+
+/**
+ * Takes the smallest element along `axes`, like reduce_sum()
+ */
+inline Tensor reduce_min(const Tensor& input,
+                         const std::vector<int64_t>& axes = {},
+                         bool keep_dims = false) {
+    if (auto result = detail::host_reduce(detail::HostReduceOp::kMin, input,
+                                          axes, keep_dims)) {
+        return *result;
+    }
+    return ops::Min(input, detail::reduction_axes(input, axes), keep_dims,
+                    TF_INT64);
+}
+
 /**
  * @return A string representing t in the form:
  * <Tensor: shape=?, dtype=?, data=?>
  * ?)
  */
 inline std::string to_string(const Tensor& t) {
-    auto output
-        = ops::StringFormat({t.shape(), Tensor {to_string_view(t.dtype())}, t},
-                            "<Tensor: shape=%s, dtype=%s, data=%s>");
+    auto output = ops::StringFormat(
+        {Tensor {t.dims().to_string()}, Tensor {to_string_view(t.dtype())}, t},
+        "<Tensor: shape=%s, dtype=%s, data=%s>");
     auto handle = output.get_tensor();
 
     auto* data = static_cast<TF_TString*>(TF_TensorData(handle.get()));
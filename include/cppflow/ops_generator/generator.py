@@ -142,9 +142,8 @@ class Operation:
         # C++ function body
         template = textwrap.dedent('''
         inline {} {}({}{}) {{
-            // Define Op
-            std::unique_ptr<TFE_Op, decltype(&TFE_DeleteOp)> op(TFE_NewOp(context::get_context(), "{}", context::get_status()), &TFE_DeleteOp);
-            status_check(context::get_status());
+            // Define Op, run eagerly or traced into a cppflow::function
+            detail::OpBuilder op("{}");
 
             // Required input arguments
             {}
@@ -157,17 +156,9 @@ class Operation:
         ''')
 
         # Add single input template
-        add_inputs = textwrap.dedent('''
-            TFE_OpAddInput(op.get(), {}.get_eager_handle().get(), context::get_status());
-            status_check(context::get_status());
-        ''').replace('\n', '\n    ')
-
-        add_inputs_list = textwrap.dedent('''
-            std::vector<TFE_TensorHandle*> {0}_handles; {0}_handles.reserve({0}.size());
-            std::transform({0}.begin(), {0}.end(), std::back_inserter({0}_handles), [](const auto& t) {{ return t.get_eager_handle().get();}});
-            TFE_OpAddInputList(op.get(), {0}_handles.data(), {0}.size(), context::get_status());
-            status_check(context::get_status());
-        ''').replace('\n', '\n    ')
+        add_inputs = 'op.add_input({});'
+
+        add_inputs_list = 'op.add_input_list({});'
 
         # snake_case name of the operation
         # op_name = re.sub(r'(?<!^)(?=[A-Z])+', '_', self.op.name).lower()
@@ -176,8 +167,9 @@ class Operation:
             op_name = f"{op_name}_"
         snk = op_name.replace('const', 'const_tensor')
 
-        # Required input arguments
-        inp = ', '.join(['const std::vector<Tensor>& {}'.format(n.name) if len(n.number_attr) or len(n.type_list_attr) else
+        # Required input arguments, list inputs are taken as spans
+        is_list = lambda n: len(n.number_attr) or len(n.type_list_attr)
+        inp = ', '.join(['std::span<const Tensor> {}'.format(n.name) if is_list(n) else
                 'const Tensor& {}'.format(n.name.replace('tensor', 'input_tensor')) for i, n in enumerate(self.inputs)])
 
         # Declaration of attributes
@@ -197,40 +189,47 @@ class Operation:
         if len(self.op.output_arg) == 0:
             # Return type of the function
             return_type = "void"
-            execute_op = f"""// Execute Op
-    constexpr auto __kNumOutputs = {len(self.op.output_arg)};
-    auto __num_outputs = __kNumOutputs;
-    TFE_TensorHandle* __output_tensor = nullptr;
-    TFE_Execute(op.get(), &__output_tensor, &__num_outputs, context::get_status());
-    status_check(context::get_status());"""
+            execute_op = """// Execute Op
+    op.execute(0);"""
         elif len(self.op.output_arg) == 1:
             return_type = "Tensor"
-            execute_op = f"""// Execute Op
-    constexpr auto __kNumOutputs = {len(self.op.output_arg)};
-    auto __num_outputs = __kNumOutputs;
-    TFE_TensorHandle* __output_tensor = nullptr;
-    TFE_Execute(op.get(), &__output_tensor, &__num_outputs, context::get_status());
-    status_check(context::get_status());
-
-    return Tensor {{__output_tensor}};"""
+            execute_op = """// Execute Op
+    return op.execute();"""
         else:
             return_type = "std::vector<Tensor>"
             execute_op = f"""// Execute Op
-    constexpr auto __kNumOutputs = {len(self.op.output_arg)};
-    auto __num_outputs = __kNumOutputs;
-    TFE_TensorHandle* __output_tensors[__kNumOutputs] = {{nullptr,}};
-    TFE_Execute(op.get(), __output_tensors, &__num_outputs, context::get_status());
-    status_check(context::get_status());
+    return op.execute({len(self.op.output_arg)});"""
+
+        code = template.format(return_type, snk, inp, atr, opn, inp_code, atr_code, execute_op)
 
-    auto __outputs = std::vector<Tensor> {{}};
-    __outputs.reserve(__num_outputs);
-    for (auto i = 0; i < __num_outputs; ++i) {{
-        __outputs.emplace_back(Tensor {{__output_tensors[i]}});
-    }}
+        if not any(is_list(n) for n in self.inputs):
+            return code
+
+        # Names of all arguments, to forward them to the span overload
+        arg_names = [n.name if is_list(n) else n.name.replace('tensor', 'input_tensor') for n in self.inputs]
+        arg_names += [a.declaration().split('=')[0].split(' ')[-1] for a in self.attr_list if len(a.declaration())]
+
+        # std::vector overload, so that braced lists of tensors still work
+        vec_inp = inp.replace('std::span<const Tensor>', 'const std::vector<Tensor>&')
+        vec_args = ', '.join('std::span<const Tensor> {{{}}}'.format(a) if i < len(self.inputs) and is_list(self.inputs[i]) else a
+                             for i, a in enumerate(arg_names))
+        code += textwrap.dedent('''
+        inline {} {}({}{}) {{
+            return {}({});
+        }}
+        ''').format(return_type, snk, vec_inp, atr, snk, vec_args)
 
-    return __outputs;"""
+        # Variadic overload for ops whose only argument is the list
+        if len(self.inputs) == 1 and all('=' in a.declaration() for a in self.attr_list if len(a.declaration())):
+            name = self.inputs[0].name
+            code += textwrap.dedent('''
+            template<typename... Tensors, std::enable_if_t<(std::is_convertible_v<const Tensors&, const Tensor&> && ...), bool> = true>
+            inline {0} {1}(const Tensor& {2}, const Tensors&... more_{2}) {{
+                return {1}(std::span<const Tensor> {{std::array<Tensor, 1 + sizeof...(Tensors)> {{{2}, more_{2}...}}}});
+            }}
+            ''').format(return_type, snk, name)
 
-        return template.format(return_type, snk, inp, atr, opn, inp_code, atr_code, execute_op)
+        return code
 
 
 
@@ -254,6 +253,9 @@ ops_file = textwrap.dedent('''
 #include <vector>
 #include <limits>
 #include <algorithm>
+#include <array>
+#include <span>
+#include <type_traits>
 
 
 namespace cppflow::ops {{
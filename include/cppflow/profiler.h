@@ -0,0 +1,361 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_PROFILER_H__
+#define __CPPFLOW2_PROFILER_H__
+
+#include "proto.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace cppflow {
+
+/**
+ * Execution of one graph node, decoded from a NodeExecStats
+ */
+struct NodeStats {
+    std::string device;
+    std::string node_name;
+    std::string op;
+    double start_micros {0};    // Absolute, since the epoch
+    double duration_micros {0};
+    uint32_t thread_id {0};
+};
+
+/**
+ * Aggregated timings of a graph node over the sampled runs
+ */
+struct NodeSummary {
+    std::string node_name;
+    std::string op;
+    std::size_t count {0};
+    double total_micros {0};
+    double min_micros {0};
+    double max_micros {0};
+
+    double mean_micros() const {
+        return count ? total_micros / static_cast<double>(count) : 0;
+    }
+};
+
+/**
+ * Decodes the step stats of a serialized tensorflow.RunMetadata
+ * @param run_metadata The RunMetadata filled by TF_SessionRun
+ * @return The timings of every node executed in the step
+ */
+inline std::vector<NodeStats> parse_step_stats(std::string_view run_metadata);
+
+/**
+ * @class Profiler
+ * @brief Samples traced runs and aggregates per-node timings
+ *
+ * Attach it to a Model with Model::set_profiler(). One run out of every
+ * `sample_every` is executed with trace_level=FULL_TRACE and its step stats
+ * recorded; the others only pay for an atomic increment. The latest
+ * `max_steps` sampled steps are kept for export as a Chrome trace
+ * (chrome://tracing or https://ui.perfetto.dev).
+ */
+class Profiler {
+public:
+    explicit Profiler(uint64_t sample_every = 1, std::size_t max_steps = 32)
+        : sample_every_(sample_every), max_steps_(max_steps) {
+    }
+
+    /**
+     * @return Whether the next run must be traced
+     */
+    bool sample() {
+        if (sample_every_ == 0) {
+            return false;
+        }
+        return counter_.fetch_add(1, std::memory_order_relaxed) % sample_every_
+               == 0;
+    }
+
+    /**
+     * Records the step stats of a traced run
+     */
+    void record(std::vector<NodeStats> step);
+
+    /**
+     * @return The serialized RunOptions requesting a full trace
+     */
+    static const std::string& run_options();
+
+    /**
+     * @return Per-node timings, most expensive nodes first
+     */
+    std::vector<NodeSummary> summary() const;
+
+    /**
+     * @return Number of traced runs recorded so far
+     */
+    std::size_t steps() const;
+
+    /**
+     * Writes the kept steps in the Chrome trace event format
+     */
+    void write_chrome_trace(const std::filesystem::path& filename) const;
+
+    void reset();
+
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+private:
+    uint64_t sample_every_;
+    std::size_t max_steps_;
+    std::atomic<uint64_t> counter_ {0};
+
+    mutable std::mutex mutex_;
+    std::size_t steps_ {0};
+    std::map<std::string, NodeSummary> nodes_;
+    std::deque<std::vector<NodeStats>> recent_;
+};
+
+}    // namespace cppflow
+
+
+namespace cppflow {
+
+namespace detail {
+
+inline NodeStats parse_node_stats(std::string_view data,
+                                  const std::string& device) {
+    auto stats = NodeStats {};
+    stats.device = device;
+
+    auto start_micros = int64_t {0};
+    auto end_rel_micros = int64_t {0};
+    auto start_nanos = int64_t {0};
+    auto end_rel_nanos = int64_t {0};
+
+    // Field numbers from tensorflow/core/framework/step_stats.proto
+    auto reader = ProtoReader {data};
+    while (reader.next()) {
+        switch (reader.field()) {
+            case 1:
+                stats.node_name = reader.bytes();
+                break;
+            case 2:
+                start_micros = reader.int64();
+                break;
+            case 5:
+                end_rel_micros = reader.int64();
+                break;
+            case 8: {
+                // "name = Op(inputs)"
+                auto label = reader.bytes();
+                auto begin = label.find(" = ");
+                auto end = label.find('(');
+                if (begin != std::string_view::npos && end != label.npos
+                    && end > begin) {
+                    stats.op = label.substr(begin + 3, end - begin - 3);
+                }
+                break;
+            }
+            case 10:
+                stats.thread_id = static_cast<uint32_t>(reader.varint());
+                break;
+            case 13:
+                start_nanos = reader.int64();
+                break;
+            case 16:
+                end_rel_nanos = reader.int64();
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (start_nanos) {
+        stats.start_micros = static_cast<double>(start_nanos) / 1000.0;
+        stats.duration_micros = static_cast<double>(end_rel_nanos) / 1000.0;
+    } else {
+        stats.start_micros = static_cast<double>(start_micros);
+        stats.duration_micros = static_cast<double>(end_rel_micros);
+    }
+    return stats;
+}
+
+inline void write_json_string(std::ostream& os, std::string_view value) {
+    os << '"';
+    for (auto c : value) {
+        switch (c) {
+            case '"':
+                os << "\\\"";
+                break;
+            case '\\':
+                os << "\\\\";
+                break;
+            case '\n':
+                os << "\\n";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    os << ' ';
+                } else {
+                    os << c;
+                }
+        }
+    }
+    os << '"';
+}
+
+}    // namespace detail
+
+inline std::vector<NodeStats> parse_step_stats(std::string_view run_metadata) {
+    auto nodes = std::vector<NodeStats> {};
+
+    // RunMetadata.step_stats -> StepStats.dev_stats -> DeviceStepStats
+    auto metadata = ProtoReader {run_metadata};
+    while (metadata.next()) {
+        if (metadata.field() != 1) {
+            continue;
+        }
+        auto step_stats = ProtoReader {metadata.bytes()};
+        while (step_stats.next()) {
+            if (step_stats.field() != 1) {
+                continue;
+            }
+
+            auto device = std::string {};
+            auto node_stats = std::vector<std::string_view> {};
+            auto device_stats = ProtoReader {step_stats.bytes()};
+            while (device_stats.next()) {
+                if (device_stats.field() == 1) {
+                    device = device_stats.bytes();
+                } else if (device_stats.field() == 2) {
+                    node_stats.emplace_back(device_stats.bytes());
+                }
+            }
+
+            for (const auto& data : node_stats) {
+                nodes.emplace_back(detail::parse_node_stats(data, device));
+            }
+        }
+    }
+
+    return nodes;
+}
+
+inline const std::string& Profiler::run_options() {
+    // RunOptions.trace_level = FULL_TRACE
+    static const auto options = ProtoWriter {}.write_int(1, 3).str();
+    return options;
+}
+
+inline void Profiler::record(std::vector<NodeStats> step) {
+    auto lock = std::lock_guard {mutex_};
+
+    ++steps_;
+    for (const auto& node : step) {
+        auto& summary = nodes_[node.node_name];
+        if (summary.count == 0) {
+            summary.node_name = node.node_name;
+            summary.op = node.op;
+            summary.min_micros = node.duration_micros;
+            summary.max_micros = node.duration_micros;
+        }
+        ++summary.count;
+        summary.total_micros += node.duration_micros;
+        summary.min_micros = std::min(summary.min_micros, node.duration_micros);
+        summary.max_micros = std::max(summary.max_micros, node.duration_micros);
+    }
+
+    if (max_steps_ > 0) {
+        if (recent_.size() == max_steps_) {
+            recent_.pop_front();
+        }
+        recent_.emplace_back(std::move(step));
+    }
+}
+
+inline std::vector<NodeSummary> Profiler::summary() const {
+    auto result = std::vector<NodeSummary> {};
+    {
+        auto lock = std::lock_guard {mutex_};
+        result.reserve(nodes_.size());
+        for (const auto& [name, summary] : nodes_) {
+            result.emplace_back(summary);
+        }
+    }
+    std::sort(result.begin(), result.end(), [](const auto& a, const auto& b) {
+        return a.total_micros > b.total_micros;
+    });
+    return result;
+}
+
+inline std::size_t Profiler::steps() const {
+    auto lock = std::lock_guard {mutex_};
+    return steps_;
+}
+
+inline void Profiler::write_chrome_trace(
+    const std::filesystem::path& filename) const {
+    auto file = std::ofstream {filename};
+    if (!file) {
+        throw std::runtime_error("Could not open " + filename.string());
+    }
+
+    auto lock = std::lock_guard {mutex_};
+
+    // One trace process per device
+    auto devices = std::map<std::string, std::size_t> {};
+    for (const auto& step : recent_) {
+        for (const auto& node : step) {
+            devices.emplace(node.device, devices.size());
+        }
+    }
+
+    file << "{\"traceEvents\":[";
+    auto first = true;
+    for (const auto& [device, pid] : devices) {
+        file << (first ? "" : ",") << "\n{\"name\":\"process_name\","
+             << "\"ph\":\"M\",\"pid\":" << pid << ",\"args\":{\"name\":";
+        detail::write_json_string(file, device);
+        file << "}}";
+        first = false;
+    }
+    for (const auto& step : recent_) {
+        for (const auto& node : step) {
+            file << (first ? "" : ",") << "\n{\"name\":";
+            detail::write_json_string(file, node.node_name);
+            file << ",\"cat\":";
+            detail::write_json_string(file, node.op);
+            file << ",\"ph\":\"X\",\"pid\":" << devices[node.device]
+                 << ",\"tid\":" << node.thread_id
+                 << ",\"ts\":" << std::fixed << node.start_micros
+                 << ",\"dur\":" << node.duration_micros << ",\"args\":{\"op\":";
+            detail::write_json_string(file, node.op);
+            file << "}}";
+            first = false;
+        }
+    }
+    file << "\n]}\n";
+}
+
+inline void Profiler::reset() {
+    auto lock = std::lock_guard {mutex_};
+    steps_ = 0;
+    nodes_.clear();
+    recent_.clear();
+}
+
+}    // namespace cppflow
+
+#endif
@@ -0,0 +1,259 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_PROTO_H__
+#define __CPPFLOW2_PROTO_H__
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+
+namespace cppflow {
+
+/**
+ * @class ProtoWriter
+ * @brief Minimal protobuf wire format encoder
+ *
+ * Enough to build the few TensorFlow configuration messages the C API takes
+ * as serialized protos (ConfigProto, RunOptions...) without depending on
+ * protobuf. Fields must be written in field number order to match what
+ * protobuf itself produces, although parsers accept any order.
+ */
+class ProtoWriter {
+public:
+    enum WireType : uint32_t {
+        kVarint = 0,
+        kFixed64 = 1,
+        kLengthDelimited = 2,
+        kFixed32 = 5,
+    };
+
+    // int32, int64, uint32, uint64 and enum fields. Negative values are
+    // sign-extended to ten bytes, like protobuf does
+    ProtoWriter& write_int(uint32_t field, int64_t value) {
+        write_tag(field, kVarint);
+        write_varint(static_cast<uint64_t>(value));
+        return *this;
+    }
+
+    ProtoWriter& write_bool(uint32_t field, bool value) {
+        return write_int(field, value ? 1 : 0);
+    }
+
+    ProtoWriter& write_double(uint32_t field, double value) {
+        auto bits = uint64_t {};
+        std::memcpy(&bits, &value, sizeof(bits));
+        write_tag(field, kFixed64);
+        for (int i = 0; i < 8; ++i) {
+            buffer_.push_back(static_cast<char>(bits >> (8 * i)));
+        }
+        return *this;
+    }
+
+    ProtoWriter& write_float(uint32_t field, float value) {
+        auto bits = uint32_t {};
+        std::memcpy(&bits, &value, sizeof(bits));
+        write_tag(field, kFixed32);
+        for (int i = 0; i < 4; ++i) {
+            buffer_.push_back(static_cast<char>(bits >> (8 * i)));
+        }
+        return *this;
+    }
+
+    // string, bytes and embedded message fields
+    ProtoWriter& write_bytes(uint32_t field, std::string_view value) {
+        write_tag(field, kLengthDelimited);
+        write_varint(value.size());
+        buffer_.append(value);
+        return *this;
+    }
+
+    ProtoWriter& write_message(uint32_t field, const ProtoWriter& message) {
+        return write_bytes(field, message.str());
+    }
+
+    bool empty() const {
+        return buffer_.empty();
+    }
+
+    const std::string& str() const {
+        return buffer_;
+    }
+
+private:
+    void write_tag(uint32_t field, WireType type) {
+        write_varint((static_cast<uint64_t>(field) << 3) | type);
+    }
+
+    void write_varint(uint64_t value) {
+        while (value >= 0x80) {
+            buffer_.push_back(static_cast<char>((value & 0x7f) | 0x80));
+            value >>= 7;
+        }
+        buffer_.push_back(static_cast<char>(value));
+    }
+
+private:
+    std::string buffer_;
+};
+
+/**
+ * @class ProtoReader
+ * @brief Minimal protobuf wire format decoder
+ *
+ * Walks the fields of a serialized message one at a time. Embedded messages
+ * are read by constructing another ProtoReader over bytes(). The views
+ * returned point into the original buffer, which must outlive the reader.
+ *
+ *     auto reader = ProtoReader {data};
+ *     while (reader.next()) {
+ *         switch (reader.field()) {
+ *             case 1: name = reader.bytes(); break;
+ *             case 2: value = reader.varint(); break;
+ *         }
+ *     }
+ */
+class ProtoReader {
+public:
+    explicit ProtoReader(std::string_view data) : data_(data) {
+    }
+
+    /**
+     * Advances to the next field
+     * @return false at the end of the message
+     */
+    bool next() {
+        if (pos_ >= data_.size()) {
+            return false;
+        }
+        auto tag = read_varint();
+        field_ = static_cast<uint32_t>(tag >> 3);
+        type_ = static_cast<ProtoWriter::WireType>(tag & 0x7);
+
+        switch (type_) {
+            case ProtoWriter::kVarint:
+                varint_ = read_varint();
+                break;
+            case ProtoWriter::kFixed64:
+                bytes_ = read_raw(8);
+                break;
+            case ProtoWriter::kLengthDelimited:
+                bytes_ = read_raw(static_cast<std::size_t>(read_varint()));
+                break;
+            case ProtoWriter::kFixed32:
+                bytes_ = read_raw(4);
+                break;
+            default:
+                throw std::runtime_error("Unsupported protobuf wire type "
+                                         + std::to_string(type_));
+        }
+        return true;
+    }
+
+    uint32_t field() const {
+        return field_;
+    }
+
+    ProtoWriter::WireType type() const {
+        return type_;
+    }
+
+    uint64_t varint() const {
+        return varint_;
+    }
+
+    int64_t int64() const {
+        return static_cast<int64_t>(varint_);
+    }
+
+    std::string_view bytes() const {
+        return bytes_;
+    }
+
+    double fixed_double() const {
+        auto bits = fixed_bits();
+        auto value = double {};
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    float fixed_float() const {
+        auto bits = static_cast<uint32_t>(fixed_bits());
+        auto value = float {};
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    /**
+     * Decodes a varint at `pos` and advances past it. Used for packed
+     * repeated fields, whose payload is a bare sequence of varints
+     */
+    static uint64_t read_varint(std::string_view data, std::size_t& pos) {
+        auto value = uint64_t {0};
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos >= data.size()) {
+                break;
+            }
+            auto byte = static_cast<uint8_t>(data[pos++]);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) {
+                return value;
+            }
+        }
+        throw std::runtime_error("Malformed protobuf varint");
+    }
+
+private:
+    uint64_t read_varint() {
+        return read_varint(data_, pos_);
+    }
+
+    std::string_view read_raw(std::size_t size) {
+        if (size > data_.size() - pos_) {
+            throw std::runtime_error("Truncated protobuf message");
+        }
+        auto view = data_.substr(pos_, size);
+        pos_ += size;
+        return view;
+    }
+
+    uint64_t fixed_bits() const {
+        auto bits = uint64_t {0};
+        for (std::size_t i = 0; i < bytes_.size(); ++i) {
+            bits |= static_cast<uint64_t>(static_cast<uint8_t>(bytes_[i]))
+                    << (8 * i);
+        }
+        return bits;
+    }
+
+private:
+    std::string_view data_;
+    std::size_t pos_ {0};
+    uint32_t field_ {0};
+    ProtoWriter::WireType type_ {ProtoWriter::kVarint};
+    uint64_t varint_ {0};
+    std::string_view bytes_;
+};
+
+namespace detail {
+
+// Reads a little-endian integer of `size` bytes, as used by fixed fields
+// and the TFRecord and zip framings
+inline uint64_t read_le(const char* data, std::size_t size) {
+    auto value = uint64_t {0};
+    for (std::size_t i = 0; i < size; ++i) {
+        value |= static_cast<uint64_t>(static_cast<uint8_t>(data[i]))
+                 << (8 * i);
+    }
+    return value;
+}
+
+}    // namespace detail
+
+}    // namespace cppflow
+
+#endif
@@ -0,0 +1,232 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_RUNNER_H__
+#define __CPPFLOW2_RUNNER_H__
+
+#include "buffer.h"
+#include "context.h"
+#include "executor.h"
+#include "profiler.h"
+#include "small_buffer.h"
+#include "tensor.h"
+
+#include <tensorflow/c/c_api.h>
+
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+namespace cppflow {
+
+class Model;
+
+namespace detail {
+
+// Inputs fed to every run of a session, such as the weights of a model
+// loaded by Model::from_graph_def()
+struct BoundInputs {
+    std::vector<TF_Output> outputs;
+    std::vector<TF_Tensor*> values;
+    // Owns the values
+    std::vector<Tensor> tensors;
+};
+
+}    // namespace detail
+
+/**
+ * @class Runner
+ * @brief A prepared call into a Model with its inputs and outputs resolved
+ *
+ * Created by Model::prepare(). All graph name lookups happen once, when the
+ * runner is created, so run() only fills the TF_SessionRun argument arrays.
+ * A runner keeps the graph and session of its model alive and can be shared
+ * between threads.
+ */
+class Runner {
+public:
+    Runner() = default;
+
+    /**
+     * Runs the session feeding the prepared inputs
+     * @param inputs One tensor per prepared input, in the same order
+     * @return One tensor per prepared output, in the same order
+     */
+    std::vector<Tensor> run(std::span<const Tensor> inputs) const;
+
+    /**
+     * Runs the session writing the results into a caller-provided span
+     * @param inputs One tensor per prepared input, in the same order
+     * @param outputs Destination for the results, one per prepared output
+     */
+    void run(std::span<const Tensor> inputs, std::span<Tensor> outputs) const;
+
+    /**
+     * Runs the session on an executor thread
+     * @param inputs One tensor per prepared input, in the same order
+     * @param executor The worker pool to run on
+     * @return A future holding one tensor per prepared output
+     * @throw RejectedError if the executor queue is full
+     */
+    std::future<std::vector<Tensor>> run_async(
+        std::vector<Tensor> inputs,
+        Executor& executor = *default_executor()) const {
+        return executor.async(
+            [runner = *this, inputs = std::move(inputs)] {
+                return runner.run(inputs);
+            });
+    }
+
+    std::vector<Tensor> operator()(std::span<const Tensor> inputs) const {
+        return run(inputs);
+    }
+
+    std::span<const TF_Output> inputs() const {
+        return inputs_;
+    }
+
+    std::span<const TF_Output> outputs() const {
+        return outputs_;
+    }
+
+    ~Runner() = default;
+    Runner(const Runner& other) = default;
+    Runner(Runner&& other) = default;
+    Runner& operator=(const Runner& other) = default;
+    Runner& operator=(Runner&& other) = default;
+
+private:
+    friend class Model;
+
+    Runner(std::shared_ptr<TF_Graph> graph,
+           std::shared_ptr<TF_Session> session,
+           std::shared_ptr<Profiler> profiler,
+           std::shared_ptr<const detail::BoundInputs> bound_inputs,
+           std::vector<TF_Output> inputs,
+           std::vector<TF_Output> outputs);
+
+    // Most signatures have a handful of inputs and outputs; up to this many
+    // are passed to TF_SessionRun from stack storage.
+    static constexpr std::size_t kInlineArgs = 16;
+
+private:
+    std::shared_ptr<TF_Graph> graph_;
+    std::shared_ptr<TF_Session> session_;
+    std::shared_ptr<Profiler> profiler_;
+    std::shared_ptr<const detail::BoundInputs> bound_inputs_;
+    std::vector<TF_Output> inputs_;
+    std::vector<TF_Output> outputs_;
+};
+
+}    // namespace cppflow
+
+
+namespace cppflow {
+
+namespace detail {
+
+// Calls TF_SessionRun, tracing the run if the profiler samples it and
+// feeding the bound inputs after the given ones
+inline void session_run(TF_Session* session, Profiler* profiler,
+                        const BoundInputs* bound_inputs,
+                        const TF_Output* inputs, TF_Tensor* const* input_values,
+                        int ninputs, const TF_Output* outputs,
+                        TF_Tensor** output_values, int noutputs) {
+    if (bound_inputs && !bound_inputs->outputs.empty()) {
+        auto count = static_cast<std::size_t>(ninputs)
+                     + bound_inputs->outputs.size();
+        auto all_inputs = SmallBuffer<TF_Output, 16>(count);
+        auto all_values = SmallBuffer<TF_Tensor*, 16>(count);
+        std::copy_n(inputs, ninputs, all_inputs.data());
+        std::copy_n(input_values, ninputs, all_values.data());
+        std::copy(bound_inputs->outputs.begin(), bound_inputs->outputs.end(),
+                  all_inputs.data() + ninputs);
+        std::copy(bound_inputs->values.begin(), bound_inputs->values.end(),
+                  all_values.data() + ninputs);
+        session_run(session, profiler, nullptr, all_inputs.data(),
+                    all_values.data(), static_cast<int>(count), outputs,
+                    output_values, noutputs);
+        return;
+    }
+
+    if (profiler && profiler->sample()) {
+        auto run_options = Buffer {Profiler::run_options()};
+        auto run_metadata = Buffer {};
+        TF_SessionRun(session, run_options.get(), inputs, input_values,
+                      ninputs, outputs, output_values, noutputs, nullptr, 0,
+                      run_metadata.get(), context::get_status());
+        status_check(context::get_status());
+
+        const auto* metadata = run_metadata.get();
+        profiler->record(parse_step_stats(
+            {static_cast<const char*>(metadata->data), metadata->length}));
+        return;
+    }
+
+    TF_SessionRun(session, nullptr, inputs, input_values, ninputs, outputs,
+                  output_values, noutputs, nullptr, 0, nullptr,
+                  context::get_status());
+    status_check(context::get_status());
+}
+
+}    // namespace detail
+
+inline Runner::Runner(std::shared_ptr<TF_Graph> graph,
+                      std::shared_ptr<TF_Session> session,
+                      std::shared_ptr<Profiler> profiler,
+                      std::shared_ptr<const detail::BoundInputs> bound_inputs,
+                      std::vector<TF_Output> inputs,
+                      std::vector<TF_Output> outputs)
+    : graph_(std::move(graph)),
+      session_(std::move(session)),
+      profiler_(std::move(profiler)),
+      bound_inputs_(std::move(bound_inputs)),
+      inputs_(std::move(inputs)),
+      outputs_(std::move(outputs)) {
+}
+
+inline std::vector<Tensor> Runner::run(std::span<const Tensor> inputs) const {
+    auto output_tensors = std::vector<Tensor>(outputs_.size());
+    run(inputs, output_tensors);
+    return output_tensors;
+}
+
+inline void Runner::run(std::span<const Tensor> inputs,
+                        std::span<Tensor> outputs) const {
+    if (inputs.size() != inputs_.size()) {
+        throw std::runtime_error(
+            "Runner expects " + std::to_string(inputs_.size())
+            + " inputs but got " + std::to_string(inputs.size()));
+    }
+    if (outputs.size() != outputs_.size()) {
+        throw std::runtime_error(
+            "Runner expects " + std::to_string(outputs_.size())
+            + " outputs but got " + std::to_string(outputs.size()));
+    }
+
+    auto input_values = SmallBuffer<TF_Tensor*, kInlineArgs>(inputs.size());
+    for (std::size_t i = 0; i < inputs.size(); ++i) {
+        input_values[i] = inputs[i].get_tensor().get();
+    }
+    auto output_values = SmallBuffer<TF_Tensor*, kInlineArgs>(outputs.size());
+
+    detail::session_run(session_.get(), profiler_.get(), bound_inputs_.get(),
+                        inputs_.data(), input_values.data(),
+                        static_cast<int>(inputs_.size()),
+                        outputs_.data(), output_values.data(),
+                        static_cast<int>(outputs_.size()));
+
+    for (std::size_t i = 0; i < outputs.size(); ++i) {
+        outputs[i] = Tensor {output_values[i]};
+    }
+}
+
+}    // namespace cppflow
+
+#endif
@@ -5,19 +5,31 @@
 #ifndef __CPPFLOW2_SESSION_H__
 #define __CPPFLOW2_SESSION_H__
 
+#include "context.h"
+#include "proto.h"
+
 #include <tensorflow/c/c_api.h>
 
+#include <cstdint>
+#include <map>
 #include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
 
 
 namespace cppflow {
 
 class SessionOptions {
 public:
-    SessionOptions() : impl_(TF_NewSessionOptions(), TF_DeleteSessionOptions) {
+    SessionOptions()
+        : impl_(TF_NewSessionOptions(), TF_DeleteSessionOptions),
+          config_(std::make_shared<std::optional<std::string>>(
+              std::string {})) {
     }
     explicit SessionOptions(TF_SessionOptions* handle)
-        : impl_(handle, TF_DeleteSessionOptions) {
+        : impl_(handle, TF_DeleteSessionOptions),
+          config_(std::make_shared<std::optional<std::string>>()) {
     }
 
     SessionOptions(const SessionOptions& other) = default;
@@ -33,10 +45,213 @@ public:
         return impl_.get();
     }
 
+    /**
+     * Sets the session configuration
+     * @param config A serialized tensorflow.ConfigProto
+     */
+    void set_config(const std::string_view& config) {
+        TF_SetConfig(impl_.get(), config.data(), config.size(),
+                     context::get_status());
+        status_check(context::get_status());
+        *config_ = std::string {config};
+    }
+
+    /**
+     * @return The configuration last passed to set_config(), empty if none
+     * was, or std::nullopt for options adopted from a handle
+     */
+    const std::optional<std::string>& config() const {
+        return *config_;
+    }
+
 private:
     std::shared_ptr<TF_SessionOptions> impl_;
+    // Shared like the handle, so that copies agree on it
+    std::shared_ptr<std::optional<std::string>> config_;
+};
+
+/**
+ * @class SessionOptionsBuilder
+ * @brief Builds SessionOptions from typed ConfigProto fields
+ *
+ * The fields are serialized to the ConfigProto wire format directly, so no
+ * protobuf dependency is needed. Fields left unset keep TensorFlow's
+ * defaults.
+ */
+class SessionOptionsBuilder {
+public:
+    // OptimizerOptions.Level
+    enum class OptimizerLevel : int32_t {
+        L0 = -1,    // No optimizations
+        L1 = 0,     // Common subexpression elimination and constant folding
+    };
+
+    // OptimizerOptions.GlobalJitLevel
+    enum class JitLevel : int32_t {
+        Default = 0,
+        Off = -1,
+        On1 = 1,
+        On2 = 2,
+    };
+
+    /**
+     * Threads used to parallelize a single op, 0 lets TensorFlow choose
+     */
+    SessionOptionsBuilder& intra_op_threads(int32_t threads) {
+        intra_op_threads_ = threads;
+        return *this;
+    }
+
+    /**
+     * Threads used to run independent ops, 0 lets TensorFlow choose
+     */
+    SessionOptionsBuilder& inter_op_threads(int32_t threads) {
+        inter_op_threads_ = threads;
+        return *this;
+    }
+
+    /**
+     * Gives the session its own thread pools instead of the process-wide
+     * ones
+     */
+    SessionOptionsBuilder& use_per_session_threads(bool enable) {
+        use_per_session_threads_ = enable;
+        return *this;
+    }
+
+    SessionOptionsBuilder& optimizer_level(OptimizerLevel level) {
+        optimizer_level_ = level;
+        return *this;
+    }
+
+    /**
+     * Enables XLA auto-clustering for the whole graph
+     */
+    SessionOptionsBuilder& global_jit_level(JitLevel level) {
+        global_jit_level_ = level;
+        return *this;
+    }
+
+    SessionOptionsBuilder& allow_soft_placement(bool enable) {
+        allow_soft_placement_ = enable;
+        return *this;
+    }
+
+    SessionOptionsBuilder& log_device_placement(bool enable) {
+        log_device_placement_ = enable;
+        return *this;
+    }
+
+    /**
+     * Maximum number of devices of a type (e.g. "GPU") to use
+     */
+    SessionOptionsBuilder& device_count(const std::string& type,
+                                        int32_t count) {
+        device_count_[type] = count;
+        return *this;
+    }
+
+    SessionOptionsBuilder& gpu_memory_fraction(double fraction) {
+        gpu_memory_fraction_ = fraction;
+        return *this;
+    }
+
+    SessionOptionsBuilder& gpu_allow_growth(bool enable) {
+        gpu_allow_growth_ = enable;
+        return *this;
+    }
+
+    /**
+     * Deadline for blocking operations, 0 or negative means no timeout
+     */
+    SessionOptionsBuilder& operation_timeout_ms(int64_t timeout) {
+        operation_timeout_ms_ = timeout;
+        return *this;
+    }
+
+    /**
+     * @return The serialized tensorflow.ConfigProto
+     */
+    std::string config() const;
+
+    SessionOptions build() const {
+        auto options = SessionOptions {};
+        options.set_config(config());
+        return options;
+    }
+
+private:
+    std::map<std::string, int32_t> device_count_;
+    std::optional<int32_t> intra_op_threads_;
+    std::optional<int32_t> inter_op_threads_;
+    std::optional<bool> use_per_session_threads_;
+    std::optional<OptimizerLevel> optimizer_level_;
+    std::optional<JitLevel> global_jit_level_;
+    std::optional<bool> allow_soft_placement_;
+    std::optional<bool> log_device_placement_;
+    std::optional<double> gpu_memory_fraction_;
+    std::optional<bool> gpu_allow_growth_;
+    std::optional<int64_t> operation_timeout_ms_;
 };
 
+inline std::string SessionOptionsBuilder::config() const {
+    // Field numbers from tensorflow/core/protobuf/config.proto
+    auto config = ProtoWriter {};
+
+    for (const auto& [type, count] : device_count_) {
+        auto entry = ProtoWriter {};
+        entry.write_bytes(1, type).write_int(2, count);
+        config.write_message(1, entry);
+    }
+    if (intra_op_threads_) {
+        config.write_int(2, *intra_op_threads_);
+    }
+    if (inter_op_threads_) {
+        config.write_int(5, *inter_op_threads_);
+    }
+
+    auto gpu_options = ProtoWriter {};
+    if (gpu_memory_fraction_) {
+        gpu_options.write_double(1, *gpu_memory_fraction_);
+    }
+    if (gpu_allow_growth_) {
+        gpu_options.write_bool(4, *gpu_allow_growth_);
+    }
+    if (!gpu_options.empty()) {
+        config.write_message(6, gpu_options);
+    }
+
+    if (allow_soft_placement_) {
+        config.write_bool(7, *allow_soft_placement_);
+    }
+    if (log_device_placement_) {
+        config.write_bool(8, *log_device_placement_);
+    }
+    if (use_per_session_threads_) {
+        config.write_bool(9, *use_per_session_threads_);
+    }
+
+    auto optimizer_options = ProtoWriter {};
+    if (optimizer_level_) {
+        optimizer_options.write_int(3, static_cast<int32_t>(*optimizer_level_));
+    }
+    if (global_jit_level_) {
+        optimizer_options.write_int(5,
+                                    static_cast<int32_t>(*global_jit_level_));
+    }
+    if (!optimizer_options.empty()) {
+        auto graph_options = ProtoWriter {};
+        graph_options.write_message(3, optimizer_options);
+        config.write_message(10, graph_options);
+    }
+
+    if (operation_timeout_ms_) {
+        config.write_int(11, *operation_timeout_ms_);
+    }
+
+    return config.str();
+}
+
 }    // namespace cppflow
 
 #endif
@@ -0,0 +1,145 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_SIGNATURE_H__
+#define __CPPFLOW2_SIGNATURE_H__
+
+#include "proto.h"
+#include "tensor_proto.h"
+
+#include <tensorflow/c/c_api.h>
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace cppflow {
+
+/**
+ * A signature input or output, decoded from a TensorInfo
+ */
+struct TensorInfo {
+    // Graph tensor name, "op:index"
+    std::string name;
+    TF_DataType dtype {TF_FLOAT};
+    // -1 for unknown dimensions
+    std::vector<int64_t> shape;
+    bool unknown_rank {false};
+    // Resolved by Model once the graph is loaded, oper is null otherwise
+    TF_Output output {nullptr, 0};
+};
+
+/**
+ * The inputs and outputs of a SavedModel signature, keyed by their logical
+ * names
+ */
+struct SignatureDef {
+    std::map<std::string, TensorInfo> inputs;
+    std::map<std::string, TensorInfo> outputs;
+    std::string method_name;
+};
+
+/**
+ * Decodes the signatures of a serialized tensorflow.MetaGraphDef
+ * @param meta_graph The MetaGraphDef filled by TF_LoadSessionFromSavedModel
+ * @return The signatures keyed by their name, e.g. "serving_default"
+ */
+inline std::map<std::string, SignatureDef> parse_signature_defs(
+    std::string_view meta_graph);
+
+}    // namespace cppflow
+
+
+namespace cppflow {
+
+namespace detail {
+
+// Reads a map<string, TensorInfo> entry
+inline void parse_tensor_info_entry(std::string_view data,
+                                    std::map<std::string, TensorInfo>& map) {
+    auto key = std::string {};
+    auto tensor_info = TensorInfo {};
+
+    auto entry = ProtoReader {data};
+    while (entry.next()) {
+        if (entry.field() == 1) {
+            key = entry.bytes();
+        } else if (entry.field() == 2) {
+            auto info = ProtoReader {entry.bytes()};
+            while (info.next()) {
+                switch (info.field()) {
+                    case 1:
+                        tensor_info.name = info.bytes();
+                        break;
+                    case 2:
+                        tensor_info.dtype
+                            = static_cast<TF_DataType>(info.varint());
+                        break;
+                    case 3:
+                        tensor_info.shape = parse_tensor_shape_proto(
+                            info.bytes(), &tensor_info.unknown_rank);
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    map.emplace(std::move(key), std::move(tensor_info));
+}
+
+}    // namespace detail
+
+inline std::map<std::string, SignatureDef> parse_signature_defs(
+    std::string_view meta_graph) {
+    auto signatures = std::map<std::string, SignatureDef> {};
+
+    // Field numbers from tensorflow/core/protobuf/meta_graph.proto
+    auto reader = ProtoReader {meta_graph};
+    while (reader.next()) {
+        if (reader.field() != 5) {
+            continue;
+        }
+
+        auto key = std::string {};
+        auto signature = SignatureDef {};
+        auto entry = ProtoReader {reader.bytes()};
+        while (entry.next()) {
+            if (entry.field() == 1) {
+                key = entry.bytes();
+            } else if (entry.field() == 2) {
+                auto def = ProtoReader {entry.bytes()};
+                while (def.next()) {
+                    switch (def.field()) {
+                        case 1:
+                            detail::parse_tensor_info_entry(def.bytes(),
+                                                            signature.inputs);
+                            break;
+                        case 2:
+                            detail::parse_tensor_info_entry(def.bytes(),
+                                                            signature.outputs);
+                            break;
+                        case 3:
+                            signature.method_name = def.bytes();
+                            break;
+                        default:
+                            break;
+                    }
+                }
+            }
+        }
+
+        signatures.emplace(std::move(key), std::move(signature));
+    }
+
+    return signatures;
+}
+
+}    // namespace cppflow
+
+#endif
@@ -0,0 +1,58 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_SMALL_BUFFER_H__
+#define __CPPFLOW2_SMALL_BUFFER_H__
+
+#include <array>
+#include <cstddef>
+#include <memory>
+
+
+namespace cppflow {
+
+// Fixed-size scratch array that lives on the stack for up to N elements and
+// only falls back to the heap when more are requested. Used on hot paths
+// that need a short C array of handles for a single TF C API call.
+template<typename T, std::size_t N>
+class SmallBuffer {
+public:
+    explicit SmallBuffer(std::size_t size) : size_(size) {
+        if (size_ > N) {
+            heap_ = std::make_unique<T[]>(size_);
+        }
+    }
+
+    SmallBuffer(const SmallBuffer&) = delete;
+    SmallBuffer& operator=(const SmallBuffer&) = delete;
+
+    T* data() {
+        return heap_ ? heap_.get() : stack_.data();
+    }
+
+    const T* data() const {
+        return heap_ ? heap_.get() : stack_.data();
+    }
+
+    std::size_t size() const {
+        return size_;
+    }
+
+    T& operator[](std::size_t i) {
+        return data()[i];
+    }
+
+    const T& operator[](std::size_t i) const {
+        return data()[i];
+    }
+
+private:
+    std::size_t size_;
+    std::array<T, N> stack_ {};
+    std::unique_ptr<T[]> heap_;
+};
+
+}    // namespace cppflow
+
+#endif
@@ -5,22 +5,57 @@
 #ifndef CPPFLOW2_TENSOR_H
 #define CPPFLOW2_TENSOR_H
 
+#include "aligned_allocator.h"
 #include "context.h"
 #include "datatype.h"
+#include "dims.h"
+#include "proto.h"
+#include "small_buffer.h"
+#include "tensor_view.h"
 
+#include <tensorflow/c/c_api.h>
 #include <tensorflow/c/eager/c_api.h>
+#include <tensorflow/c/eager/c_api_experimental.h>
 #include <tensorflow/c/tf_tensor.h>
 
+#include <algorithm>
 #include <cstring>
+#include <functional>
+#include <iterator>
 #include <memory>
 #include <span>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 
 namespace cppflow {
 
+namespace detail {
+
+template<typename T>
+inline constexpr bool is_string_like_v
+    = std::is_convertible_v<const T&, std::string_view>;
+
+template<typename Range, typename = void>
+struct is_string_range : std::false_type {};
+
+template<typename Range>
+struct is_string_range<
+    Range, std::void_t<decltype(std::begin(std::declval<const Range&>())),
+                       decltype(std::end(std::declval<const Range&>()))>>
+    : std::bool_constant<is_string_like_v<std::remove_cvref_t<
+          decltype(*std::begin(std::declval<const Range&>()))>>> {};
+
+template<typename Range>
+inline constexpr bool is_string_range_v = is_string_range<Range>::value;
+
+}    // namespace detail
+
 /**
  * @class tensor
  * @brief A TensorFlow eager tensor wrapper
@@ -36,11 +71,63 @@ public:
      * @param values The values to be converted (in a flattened version)
      * @param shape The shape of the converted tensor
      */
-    template<typename T>
+    template<typename T,
+             std::enable_if_t<!detail::is_string_like_v<T>, bool> = true>
     Tensor(const std::vector<T>& values, const std::vector<int64_t>& shape);
-    template<typename T>
+    template<typename T,
+             std::enable_if_t<!detail::is_string_like_v<T>, bool> = true>
     Tensor(const std::span<T>& values, const std::vector<int64_t>& shape);
 
+    /**
+     * Creates a string tensor of any shape. All elements are initialised in
+     * a single pass over one allocation; strings short enough for the
+     * TF_TString inline representation need no allocation of their own.
+     * @param values A range of strings or string_views, in row-major order
+     * @param shape The shape of the tensor, matching the number of values
+     */
+    template<typename Range,
+             std::enable_if_t<detail::is_string_range_v<Range>, bool> = true>
+    Tensor(const Range& values, const std::vector<int64_t>& shape);
+
+    /**
+     * Creates a tensor that takes over the storage of `values` without
+     * copying it. The storage must be aligned to kTensorAlignment, which
+     * AlignedVector guarantees; otherwise the values are copied.
+     * @param values The values, moved from
+     * @param shape The shape of the tensor, matching the number of values
+     */
+    template<typename T, typename Alloc,
+             std::enable_if_t<
+                 detail::is_numeric_v<T> && !std::is_same_v<T, bool>, bool>
+             = true>
+    Tensor(std::vector<T, Alloc>&& values, const std::vector<int64_t>& shape);
+
+    /**
+     * Creates a tensor over memory owned by the caller, without copying it.
+     * The memory must stay valid and unchanged until `deleter(data)` is
+     * called, when the last tensor referring to it is destroyed. This may
+     * be long after this Tensor, as TensorFlow can keep the buffer alive.
+     * @param values The values, aligned to kTensorAlignment
+     * @param shape The shape of the tensor, matching the number of values
+     * @param deleter Called with `values.data()` to release the memory
+     * @throw std::runtime_error if the memory is misaligned or the shape
+     * does not match
+     */
+    template<typename T, typename Deleter,
+             std::enable_if_t<std::is_invocable_v<Deleter&, T*>, bool> = true>
+    Tensor(std::span<T> values, const std::vector<int64_t>& shape,
+           Deleter deleter);
+
+    /**
+     * Creates a tensor of another floating point type from float values,
+     * converting them on the way
+     * @param values The values to be converted
+     * @param shape The shape of the tensor, matching the number of values
+     * @param dtype TF_HALF, TF_BFLOAT16 or TF_FLOAT
+     */
+    Tensor(std::span<const float> values, const std::vector<int64_t>& shape,
+           datatype dtype);
+
     /**
      * Creates a flat tensor with the given values
      * @tparam T A type that can be convertible into a tensor
@@ -68,11 +155,30 @@ public:
      */
     Tensor shape() const;
 
+    /**
+     * Reads the shape from the handle, without running an op. On an async
+     * context this waits for the op producing the tensor
+     * @return The dimensions of the tensor
+     * @throw std::runtime_error if the op producing the tensor failed
+     */
+    Dims dims() const;
+
+    /**
+     * @return The number of elements, 1 for a scalar
+     */
+    int64_t num_elements() const;
+
+    /**
+     * @return The size of the tensor data in bytes
+     */
+    std::size_t byte_size() const;
+
     /**
      * @param on_memory If false, the function will return the name of the
      * device that produced the tensor. If true, the function will return the
      * name of the device in whose memory the tensor resides
-     * @return Returns the name of the device of the tensor
+     * @return Returns the name of the device of the tensor, empty for
+     * symbolic tensors
      */
     std::string_view device(bool on_memory = false) const;
 
@@ -86,7 +192,7 @@ public:
      * @tparam T The C++ type (must be equivalent to the tensor type)
      * @return A span representing the flat tensor
      */
-    template<typename T, std::enable_if_t<std::is_arithmetic_v<T>, bool> = true>
+    template<typename T, std::enable_if_t<detail::is_numeric_v<T>, bool> = true>
     std::span<T> get_data() const {
         // Check if asked datatype and tensor datatype match
         if (this->dtype() != deduce_tf_type<T>()) {
@@ -113,6 +219,38 @@ public:
         return std::span<T> {begin, end};
     }
 
+    /**
+     * Copies the tensor values, converting between float, float16 and
+     * bfloat16 if the tensor holds another one of them
+     * @tparam T The C++ type of the returned values
+     * @return The flat values
+     */
+    template<typename T, std::enable_if_t<detail::is_numeric_v<T>, bool> = true>
+    std::vector<T> get_data_as() const;
+
+    /**
+     * Views the tensor as a row-major multidimensional array
+     * @tparam T The C++ type (must be equivalent to the tensor type)
+     * @tparam Rank The rank of the tensor
+     * @return A view over the tensor data
+     * @throw std::runtime_error if the datatype or the rank do not match
+     */
+    template<typename T, std::size_t Rank>
+    TensorView<T, Rank> view() const {
+        auto data = get_data<std::remove_const_t<T>>();
+        auto dims = this->dims();
+        if (dims.rank() != Rank) {
+            throw std::runtime_error(
+                "Rank in function view (" + std::to_string(Rank)
+                + ") does not match tensor rank ("
+                + std::to_string(dims.rank()) + ")");
+        }
+
+        auto extents = typename TensorView<T, Rank>::extents_type {};
+        std::copy(dims.begin(), dims.end(), extents.begin());
+        return {data.data(), extents};
+    }
+
     /**
      * Converts the tensor into a C++ string
      * @tparam T The C++ string type (must be equivalent to the tensor type)
@@ -121,7 +259,8 @@ public:
     template<typename T,
              std::enable_if_t<std::is_same_v<T, std::string_view>, bool> = true>
     std::string_view get_data() const {
-        auto handle = tf_tensor_.get();
+        auto tensor = get_tensor();
+        auto handle = tensor.get();
         if (TF_TensorType(handle) != TF_STRING) {
             auto type = cppflow::to_string(this->dtype());
             auto message
@@ -149,6 +288,12 @@ public:
         return std::string {get_data<std::string_view>()};
     }
 
+    /**
+     * Views every element of a string tensor, without copying
+     * @return The strings in row-major order, valid while the tensor lives
+     */
+    std::vector<std::string_view> get_strings() const;
+
     ~Tensor() = default;
     Tensor(const Tensor& tensor) = default;
     Tensor(Tensor&& tensor) = default;
@@ -157,6 +302,18 @@ public:
 
     explicit Tensor(TFE_TensorHandle* handle);
     explicit Tensor(TF_Tensor* t);
+    explicit Tensor(std::shared_ptr<TF_Tensor> t);
+
+    /**
+     * Creates a symbolic tensor, an output of the graph traced by
+     * cppflow::function. It has a dtype and dims but no values, and keeps
+     * the graph alive.
+     */
+    Tensor(std::shared_ptr<TF_Graph> graph, TF_Output output);
+
+    bool is_symbolic() const {
+        return graph_ != nullptr;
+    }
 
     // NOTE: Usually, one should not call get_eager_handle() or get_tensor()
     // below.
@@ -170,9 +327,19 @@ public:
 
     // TODO: Need to determine if we can mark the return value or *this as const
     std::shared_ptr<TFE_TensorHandle> get_eager_handle() const {
+        check_eager();
         return tfe_handle_;
     }
 
+    // The graph and op output of a symbolic tensor
+    TF_Graph* get_graph() const {
+        return graph_.get();
+    }
+
+    TF_Output get_output() const {
+        return output_;
+    }
+
     // Get the TF_Tensor data from the eager handle
     // Call `get_data<T>()` instead if possible
     // NOTE: Changes to the returned TF_Tensor may not be reflected in the
@@ -185,6 +352,9 @@ private:
     Tensor(TF_DataType type, const void* data, size_t len,
            const std::vector<int64_t>& shape);
 
+    // Throws for symbolic tensors, which have no values
+    void check_eager() const;
+
 private:
     // This member serves as a local cache of the data in tfe_handle.
     // It refers to `local_mirrors_` if on device, or `data_` if on host CPU.
@@ -193,8 +363,74 @@ private:
     // not in constructor
     mutable std::shared_ptr<TF_Tensor> tf_tensor_;
     std::shared_ptr<TFE_TensorHandle> tfe_handle_;
+    // Set instead of the handle for symbolic tensors
+    std::shared_ptr<TF_Graph> graph_;
+    TF_Output output_ {nullptr, 0};
 };
 
+namespace detail {
+
+// The graph cppflow::function is tracing on this thread
+struct Trace {
+    std::shared_ptr<TF_Graph> graph;
+    // Used to name the ops added to the graph
+    std::size_t next_id {0};
+    // Eager tensors used by the traced code, embedded as constants. The
+    // handles are kept alive so that their addresses stay unique.
+    std::unordered_map<TFE_TensorHandle*,
+                       std::pair<std::shared_ptr<TFE_TensorHandle>, TF_Output>>
+        captures {};
+};
+
+inline Trace*& active_trace() {
+    thread_local Trace* trace = nullptr;
+    return trace;
+}
+
+/**
+ * Builds one op. It is run eagerly, or added to the graph when the thread
+ * is tracing a cppflow::function. Attributes are set on get() in both
+ * cases, and copied to the graph op when it is finished.
+ */
+class OpBuilder {
+public:
+    explicit OpBuilder(const char* name);
+    ~OpBuilder();
+
+    OpBuilder(const OpBuilder&) = delete;
+    OpBuilder& operator=(const OpBuilder&) = delete;
+
+    TFE_Op* get() const {
+        return op_.get();
+    }
+
+    void add_input(const Tensor& input);
+    void add_input_list(std::span<const Tensor> inputs);
+
+    /**
+     * Runs an op with a single output
+     * @return The output
+     */
+    Tensor execute();
+
+    /**
+     * Runs an op
+     * @param num_outputs The number of outputs expected when run eagerly
+     * @return The outputs
+     */
+    std::vector<Tensor> execute(int num_outputs);
+
+private:
+    TF_Output graph_input(const Tensor& input);
+    TF_Operation* finish();
+
+    CachedOp op_;
+    Trace* trace_;
+    TF_OperationDescription* description_ {nullptr};
+};
+
+}    // namespace detail
+
 }    // namespace cppflow
 
 
@@ -224,22 +460,165 @@ inline Tensor::Tensor(TF_DataType type, const void* data, size_t len,
       }()) {
 }
 
-template<typename T>
+template<typename T, std::enable_if_t<!detail::is_string_like_v<T>, bool>>
 Tensor::Tensor(const std::vector<T>& values, const std::vector<int64_t>& shape)
     : Tensor(deduce_tf_type<T>(), values.data(), values.size() * sizeof(T),
              shape) {
 }
 
-template<typename T>
+template<typename T, std::enable_if_t<!detail::is_string_like_v<T>, bool>>
 Tensor::Tensor(const std::span<T>& values, const std::vector<int64_t>& shape)
     : Tensor(deduce_tf_type<T>(), values.data(), values.size() * sizeof(T),
              shape) {
 }
 
+namespace detail {
+
+// Allocates a TF_STRING tensor whose TF_TStrings are released with it
+inline std::shared_ptr<TF_Tensor> allocate_string_tensor(
+    const std::vector<int64_t>& shape, std::size_t count) {
+    auto* tensor
+        = TF_AllocateTensor(TF_STRING, shape.data(),
+                            static_cast<int>(shape.size()),
+                            count * sizeof(TF_TString));
+    auto* data = static_cast<TF_TString*>(TF_TensorData(tensor));
+    for (std::size_t i = 0; i < count; ++i) {
+        TF_TString_Init(data + i);
+    }
+    return {tensor, [count](TF_Tensor* handle) {
+                auto* data = static_cast<TF_TString*>(TF_TensorData(handle));
+                for (std::size_t i = 0; i < count; ++i) {
+                    TF_TString_Dealloc(data + i);
+                }
+                TF_DeleteTensor(handle);
+            }};
+}
+
+inline void check_element_count(const std::vector<int64_t>& shape,
+                                std::size_t count) {
+    auto expected = std::size_t {1};
+    for (auto dim : shape) {
+        if (dim < 0) {
+            throw std::runtime_error("Tensor shape has a negative dimension");
+        }
+        expected *= static_cast<std::size_t>(dim);
+    }
+    if (expected != count) {
+        throw std::runtime_error("Tensor shape holds "
+                                 + std::to_string(expected) + " elements but "
+                                 + std::to_string(count) + " were given");
+    }
+}
+
+}    // namespace detail
+
+template<typename T, typename Alloc,
+         std::enable_if_t<detail::is_numeric_v<T> && !std::is_same_v<T, bool>,
+                          bool>>
+Tensor::Tensor(std::vector<T, Alloc>&& values,
+               const std::vector<int64_t>& shape)
+    : Tensor([&]() {
+          detail::check_element_count(shape, values.size());
+          if (!is_tensor_aligned(values.data())) {
+              return Tensor {deduce_tf_type<T>(), values.data(),
+                             values.size() * sizeof(T), shape};
+          }
+
+          using Vector = std::vector<T, Alloc>;
+          auto* owner = new Vector {std::move(values)};
+          auto* tensor = TF_NewTensor(
+              deduce_tf_type<T>(), shape.data(),
+              static_cast<int>(shape.size()), owner->data(),
+              owner->size() * sizeof(T),
+              [](void*, size_t, void* arg) {
+                  delete static_cast<Vector*>(arg);
+              },
+              owner);
+          return Tensor {tensor};
+      }()) {
+}
+
+template<typename T, typename Deleter,
+         std::enable_if_t<std::is_invocable_v<Deleter&, T*>, bool>>
+Tensor::Tensor(std::span<T> values, const std::vector<int64_t>& shape,
+               Deleter deleter)
+    : Tensor([&]() {
+          detail::check_element_count(shape, values.size());
+          if (!is_tensor_aligned(values.data())) {
+              throw std::runtime_error(
+                  "Memory wrapped by a Tensor must be aligned to "
+                  + std::to_string(kTensorAlignment) + " bytes");
+          }
+
+          // The deleter travels with the buffer, as TF_NewTensor's argument
+          using Release = std::function<void()>;
+          auto* data = values.data();
+          auto* release = new Release {
+              [data, deleter = std::move(deleter)]() mutable {
+                  deleter(data);
+              }};
+          auto* tensor = TF_NewTensor(
+              deduce_tf_type<std::remove_const_t<T>>(), shape.data(),
+              static_cast<int>(shape.size()),
+              const_cast<std::remove_const_t<T>*>(data),
+              values.size() * sizeof(T),
+              [](void*, size_t, void* arg) {
+                  auto* release = static_cast<Release*>(arg);
+                  (*release)();
+                  delete release;
+              },
+              release);
+          return Tensor {tensor};
+      }()) {
+}
+
+template<typename Range,
+         std::enable_if_t<detail::is_string_range_v<Range>, bool>>
+Tensor::Tensor(const Range& values, const std::vector<int64_t>& shape)
+    : Tensor([&]() {
+          auto count = static_cast<std::size_t>(
+              std::distance(std::begin(values), std::end(values)));
+          detail::check_element_count(shape, count);
+
+          auto tensor = detail::allocate_string_tensor(shape, count);
+          auto* data = static_cast<TF_TString*>(TF_TensorData(tensor.get()));
+          for (const auto& value : values) {
+              auto view = std::string_view {value};
+              TF_TString_Copy(data++, view.data(), view.size());
+          }
+          return tensor;
+      }()) {
+}
+
+inline Tensor::Tensor(std::span<const float> values,
+                      const std::vector<int64_t>& shape, datatype dtype)
+    : Tensor([&]() {
+          detail::check_element_count(shape, values.size());
+          auto element_size = dtype == TF_FLOAT ? sizeof(float) : 2;
+          if (dtype != TF_FLOAT && dtype != TF_HALF && dtype != TF_BFLOAT16) {
+              throw std::runtime_error("Cannot convert float values to "
+                                       + cppflow::to_string(dtype));
+          }
+
+          auto* tensor = TF_AllocateTensor(dtype, shape.data(),
+                                           static_cast<int>(shape.size()),
+                                           values.size() * element_size);
+          auto* data = TF_TensorData(tensor);
+          if (dtype == TF_HALF) {
+              convert(values, {static_cast<float16*>(data), values.size()});
+          } else if (dtype == TF_BFLOAT16) {
+              convert(values, {static_cast<bfloat16*>(data), values.size()});
+          } else {
+              std::memcpy(data, values.data(), values.size_bytes());
+          }
+          return Tensor {tensor};
+      }()) {
+}
+
 template<typename T>
 Tensor::Tensor(const std::initializer_list<T>& values,
                const std::initializer_list<int64_t>& shape)
-    : Tensor(std::vector<T> {values}, std::vector {shape}) {
+    : Tensor(std::vector<T> {values}, std::vector<int64_t> {shape}) {
 }
 
 template<typename T>
@@ -281,35 +660,164 @@ inline Tensor::Tensor(TFE_TensorHandle* handle) {
     tfe_handle_ = {handle, TFE_DeleteTensorHandle};
 }
 
-inline Tensor::Tensor(TF_Tensor* t) {
-    tf_tensor_ = {t, TF_DeleteTensor};
+inline Tensor::Tensor(std::shared_ptr<TF_Graph> graph, TF_Output output)
+    : graph_(std::move(graph)), output_(output) {
+}
+
+inline void Tensor::check_eager() const {
+    if (graph_) {
+        throw std::runtime_error("A symbolic tensor has no values, it can "
+                                 "only be used by the cppflow::function "
+                                 "tracing it");
+    }
+}
+
+inline Tensor::Tensor(TF_Tensor* t)
+    : Tensor(std::shared_ptr<TF_Tensor> {t, TF_DeleteTensor}) {
+}
+
+inline Tensor::Tensor(std::shared_ptr<TF_Tensor> t) {
+    tf_tensor_ = std::move(t);
     tfe_handle_ = {TFE_NewTensorHandle(tf_tensor_.get(), context::get_status()),
                    TFE_DeleteTensorHandle};
     status_check(context::get_status());
 }
 
-inline Tensor Tensor::shape() const {
-    auto op = TFE_NewOp(context::get_context(), "Shape", context::get_status());
-    status_check(context::get_status());
+template<typename T, std::enable_if_t<detail::is_numeric_v<T>, bool>>
+std::vector<T> Tensor::get_data_as() const {
+    auto type = dtype();
+    if (type == deduce_tf_type<T>()) {
+        auto data = get_data<T>();
+        return {data.begin(), data.end()};
+    }
 
-    TFE_OpAddInput(op, tfe_handle_.get(), context::get_status());
-    status_check(context::get_status());
+    if constexpr (std::is_same_v<T, float>) {
+        if (type == TF_HALF) {
+            auto data = get_data<float16>();
+            auto result = std::vector<float>(data.size());
+            convert(data, result);
+            return result;
+        }
+        if (type == TF_BFLOAT16) {
+            auto data = get_data<bfloat16>();
+            auto result = std::vector<float>(data.size());
+            convert(data, result);
+            return result;
+        }
+    } else if constexpr (std::is_same_v<T, float16>
+                         || std::is_same_v<T, bfloat16>) {
+        if (type == TF_FLOAT) {
+            auto data = get_data<float>();
+            auto result = std::vector<T>(data.size());
+            convert(data, result);
+            return result;
+        }
+    }
+
+    throw std::runtime_error("Cannot convert tensor of type "
+                             + cppflow::to_string(type) + " to "
+                             + cppflow::to_string(deduce_tf_type<T>()));
+}
+
+inline std::vector<std::string_view> Tensor::get_strings() const {
+    auto tensor = get_tensor();
+    if (TF_TensorType(tensor.get()) != TF_STRING) {
+        throw std::runtime_error(
+            "Datatype in function get_strings() does not match tensor "
+            "datatype ("
+            + cppflow::to_string(TF_TensorType(tensor.get())) + ")");
+    }
+
+    const auto* data
+        = static_cast<const TF_TString*>(TF_TensorData(tensor.get()));
+    auto strings = std::vector<std::string_view>(
+        static_cast<std::size_t>(TF_TensorElementCount(tensor.get())));
+    for (auto& string : strings) {
+        string = {TF_TString_GetDataPointer(data), TF_TString_GetSize(data)};
+        ++data;
+    }
+    return strings;
+}
+
+inline Tensor Tensor::shape() const {
+    auto op = detail::OpBuilder {"Shape"};
+    op.add_input(*this);
 
     // Output type should be int64_t
-    TFE_OpSetAttrType(op, "out_type", cppflow::datatype::TF_INT64);
+    TFE_OpSetAttrType(op.get(), "out_type", cppflow::datatype::TF_INT64);
 
-    // EXECUTE
-    int n = 1;
-    TFE_TensorHandle* res[1] = {nullptr};
-    TFE_Execute(op, res, &n, context::get_status());
-    status_check(context::get_status());
-    TFE_DeleteOp(op);
+    return op.execute();
+}
+
+inline Dims Tensor::dims() const {
+    if (graph_) {
+        // As far as shape inference knows, with -1 for unknown dimensions
+        auto rank = TF_GraphGetTensorNumDims(graph_.get(), output_,
+                                             context::get_status());
+        status_check(context::get_status());
+        if (rank < 0) {
+            throw std::runtime_error("The rank of the symbolic tensor is "
+                                     "unknown");
+        }
+        auto dims = Dims(static_cast<std::size_t>(rank));
+        TF_GraphGetTensorShape(graph_.get(), output_, dims.data(), rank,
+                               context::get_status());
+        status_check(context::get_status());
+        return dims;
+    }
+
+    if (tf_tensor_) {
+        auto rank = TF_NumDims(tf_tensor_.get());
+        auto dims = Dims(static_cast<std::size_t>(rank));
+        for (std::size_t i = 0; i < dims.rank(); ++i) {
+            dims[i] = TF_Dim(tf_tensor_.get(), static_cast<int>(i));
+        }
+        return dims;
+    }
+
+    auto rank
+        = TFE_TensorHandleNumDims(tfe_handle_.get(), context::get_status());
+    detail::async_status_check(context::get_status());
+    auto dims = Dims(static_cast<std::size_t>(rank));
+    for (int i = 0; i < rank; ++i) {
+        dims[i] = TFE_TensorHandleDim(tfe_handle_.get(), i,
+                                      context::get_status());
+        detail::async_status_check(context::get_status());
+    }
+    return dims;
+}
+
+inline int64_t Tensor::num_elements() const {
+    if (tf_tensor_) {
+        return TF_TensorElementCount(tf_tensor_.get());
+    }
+    if (graph_) {
+        return dims().num_elements();
+    }
+
+    auto count
+        = TFE_TensorHandleNumElements(tfe_handle_.get(), context::get_status());
+    detail::async_status_check(context::get_status());
+    return count;
+}
+
+inline std::size_t Tensor::byte_size() const {
+    if (tf_tensor_) {
+        return TF_TensorByteSize(tf_tensor_.get());
+    }
 
-    return Tensor {res[0]};
+    // TF_DataTypeSize is 0 for strings
+    auto type = dtype();
+    auto element_size
+        = type == TF_STRING ? sizeof(TF_TString) : TF_DataTypeSize(type);
+    return static_cast<std::size_t>(num_elements()) * element_size;
 }
 
 inline std::string_view Tensor::device(bool on_memory) const {
     auto name = std::string_view {};
+    if (graph_) {
+        return name;
+    }
 
     if (on_memory)
         name = TFE_TensorHandleBackingDeviceName(tfe_handle_.get(),
@@ -318,26 +826,187 @@ inline std::string_view Tensor::device(bool on_memory) const {
         name = TFE_TensorHandleDeviceName(tfe_handle_.get(),
                                           context::get_status());
 
-    status_check(context::get_status());
+    detail::async_status_check(context::get_status());
 
     return name;
 }
 
 inline datatype Tensor::dtype() const {
+    if (graph_) {
+        return TF_OperationOutputType(output_);
+    }
     return TFE_TensorHandleDataType(tfe_handle_.get());
 }
 
 // NOTE: Changes to the returned TF_Tensor are not reflected in the actual
 // device memory!
 inline std::shared_ptr<TF_Tensor> Tensor::get_tensor() const {
+    check_eager();
     if (!tf_tensor_) {
+        // Waits for the op producing the handle in async mode, and throws
+        // its error
         tf_tensor_ = {
             TFE_TensorHandleResolve(tfe_handle_.get(), context::get_status()),
             TF_DeleteTensor};
-        status_check(context::get_status());
+        detail::async_status_check(context::get_status());
     }
     return tf_tensor_;
 }
+
+namespace detail {
+
+inline OpBuilder::OpBuilder(const char* name)
+    : op_(name), trace_(active_trace()) {
+    if (trace_) {
+        auto op_name = std::string {name} + "_"
+                       + std::to_string(trace_->next_id++);
+        description_
+            = TF_NewOperation(trace_->graph.get(), name, op_name.c_str());
+    }
+}
+
+inline OpBuilder::~OpBuilder() {
+    if (description_) {
+        // Only finishing releases a description. The op is left in the
+        // graph, which is discarded with the failed trace.
+        TF_FinishOperation(description_, context::get_status());
+    }
+}
+
+inline TF_Output OpBuilder::graph_input(const Tensor& input) {
+    if (input.is_symbolic()) {
+        if (input.get_graph() != trace_->graph.get()) {
+            throw std::runtime_error("A symbolic tensor can only be used by "
+                                     "the cppflow::function tracing it");
+        }
+        return input.get_output();
+    }
+
+    auto handle = input.get_eager_handle();
+    auto capture = trace_->captures.find(handle.get());
+    if (capture != trace_->captures.end()) {
+        return capture->second.second;
+    }
+    auto name = "Const_" + std::to_string(trace_->next_id++);
+    auto* constant
+        = TF_NewOperation(trace_->graph.get(), "Const", name.c_str());
+    TF_SetAttrTensor(constant, "value", input.get_tensor().get(),
+                     context::get_status());
+    TF_SetAttrType(constant, "dtype", input.dtype());
+    if (TF_GetCode(context::get_status()) != TF_OK) {
+        auto message = std::string {TF_Message(context::get_status())};
+        TF_FinishOperation(constant, context::get_status());
+        throw std::runtime_error(message);
+    }
+    auto output
+        = TF_Output {TF_FinishOperation(constant, context::get_status()), 0};
+    status_check(context::get_status());
+    trace_->captures.emplace(handle.get(), std::pair {handle, output});
+    return output;
+}
+
+inline void OpBuilder::add_input(const Tensor& input) {
+    if (trace_) {
+        TF_AddInput(description_, graph_input(input));
+        return;
+    }
+    TFE_OpAddInput(op_.get(), input.get_eager_handle().get(),
+                   context::get_status());
+    status_check(context::get_status());
+}
+
+inline void OpBuilder::add_input_list(std::span<const Tensor> inputs) {
+    if (trace_) {
+        auto outputs = SmallBuffer<TF_Output, 64>(inputs.size());
+        std::transform(inputs.begin(), inputs.end(), outputs.data(),
+                       [this](const auto& t) { return graph_input(t); });
+        TF_AddInputList(description_, outputs.data(),
+                        static_cast<int>(inputs.size()));
+        return;
+    }
+    auto handles = SmallBuffer<TFE_TensorHandle*, 64>(inputs.size());
+    std::transform(inputs.begin(), inputs.end(), handles.data(),
+                   [](const auto& t) { return t.get_eager_handle().get(); });
+    TFE_OpAddInputList(op_.get(), handles.data(),
+                       static_cast<int>(inputs.size()),
+                       context::get_status());
+    status_check(context::get_status());
+}
+
+inline TF_Operation* OpBuilder::finish() {
+    // The attributes set on the eager op, as a serialized NameAttrList
+    auto attrs = std::unique_ptr<TF_Buffer, decltype(&TF_DeleteBuffer)> {
+        TF_NewBuffer(), TF_DeleteBuffer};
+    TFE_OpAttrsSerialize(TFE_OpGetAttrs(op_.get()), attrs.get(),
+                         context::get_status());
+    status_check(context::get_status());
+
+    auto list = ProtoReader {{static_cast<const char*>(attrs->data),
+                              attrs->length}};
+    while (list.next()) {
+        if (list.field() != 2) {
+            continue;
+        }
+        // map<string, AttrValue> entry
+        auto name = std::string {};
+        auto value = std::string_view {};
+        auto entry = ProtoReader {list.bytes()};
+        while (entry.next()) {
+            if (entry.field() == 1) {
+                name = entry.bytes();
+            } else if (entry.field() == 2) {
+                value = entry.bytes();
+            }
+        }
+        TF_SetAttrValueProto(description_, name.c_str(), value.data(),
+                             value.size(), context::get_status());
+        status_check(context::get_status());
+    }
+
+    auto* operation = TF_FinishOperation(std::exchange(description_, nullptr),
+                                         context::get_status());
+    status_check(context::get_status());
+    return operation;
+}
+
+inline Tensor OpBuilder::execute() {
+    if (trace_) {
+        return Tensor {trace_->graph, TF_Output {finish(), 0}};
+    }
+
+    auto num_outputs = 1;
+    TFE_TensorHandle* output = nullptr;
+    TFE_Execute(op_.get(), &output, &num_outputs, context::get_status());
+    async_status_check(context::get_status());
+    return Tensor {output};
+}
+
+inline std::vector<Tensor> OpBuilder::execute(int num_outputs) {
+    auto outputs = std::vector<Tensor> {};
+    if (trace_) {
+        auto* operation = finish();
+        num_outputs = TF_OperationNumOutputs(operation);
+        outputs.reserve(static_cast<std::size_t>(num_outputs));
+        for (auto i = 0; i < num_outputs; ++i) {
+            outputs.emplace_back(trace_->graph, TF_Output {operation, i});
+        }
+        return outputs;
+    }
+
+    auto handles = SmallBuffer<TFE_TensorHandle*, 16>(
+        static_cast<std::size_t>(num_outputs));
+    TFE_Execute(op_.get(), handles.data(), &num_outputs,
+                context::get_status());
+    async_status_check(context::get_status());
+    outputs.reserve(static_cast<std::size_t>(num_outputs));
+    for (auto i = 0; i < num_outputs; ++i) {
+        outputs.emplace_back(handles.data()[i]);
+    }
+    return outputs;
+}
+
+}    // namespace detail
+
 }    // namespace cppflow
 
 #endif    // CPPFLOW2_TENSOR_H
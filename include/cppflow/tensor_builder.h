@@ -0,0 +1,137 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_TENSOR_BUILDER_H__
+#define __CPPFLOW2_TENSOR_BUILDER_H__
+
+#include "datatype.h"
+#include "tensor.h"
+#include "tensor_view.h"
+
+#include <tensorflow/c/tf_tensor.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+namespace cppflow {
+
+/**
+ * @class TensorBuilder
+ * @brief Fills a TensorFlow-owned buffer in place and turns it into a Tensor
+ *
+ * The buffer is allocated by TensorFlow when the builder is created, so the
+ * values are written exactly once and finish() hands the buffer over
+ * without copying it.
+ *
+ *     auto builder = TensorBuilder<float> {{batch, 224, 224, 3}};
+ *     auto pixels = builder.view<4>();
+ *     ...    // write pixels(b, y, x, c)
+ *     auto input = builder.finish();
+ */
+template<typename T>
+class TensorBuilder {
+public:
+    static_assert(detail::is_numeric_v<T>,
+                  "TensorBuilder only supports numeric element types");
+
+    /**
+     * Allocates the uninitialised buffer of the tensor
+     * @param shape The shape of the tensor
+     */
+    explicit TensorBuilder(const std::vector<int64_t>& shape);
+
+    TensorBuilder(TensorBuilder&& other) noexcept = default;
+    TensorBuilder& operator=(TensorBuilder&& other) noexcept = default;
+
+    const std::vector<int64_t>& shape() const {
+        return shape_;
+    }
+
+    /**
+     * @return The writable values in row-major order
+     * @throw std::runtime_error if finish() was called
+     */
+    std::span<T> data() const;
+
+    /**
+     * @return The writable values as a multidimensional view
+     * @throw std::runtime_error if Rank is not the rank of the shape or
+     * finish() was called
+     */
+    template<std::size_t Rank>
+    TensorView<T, Rank> view() const;
+
+    /**
+     * Creates the tensor from the buffer, which is no longer accessible
+     * through the builder
+     * @throw std::runtime_error if finish() was called before
+     */
+    Tensor finish();
+
+private:
+    std::vector<int64_t> shape_;
+    std::unique_ptr<TF_Tensor, decltype(&TF_DeleteTensor)> tensor_;
+};
+
+}    // namespace cppflow
+
+
+namespace cppflow {
+
+template<typename T>
+TensorBuilder<T>::TensorBuilder(const std::vector<int64_t>& shape)
+    : shape_(shape), tensor_(nullptr, TF_DeleteTensor) {
+    auto count = std::size_t {1};
+    for (auto dim : shape_) {
+        if (dim < 0) {
+            throw std::runtime_error("Tensor shape has a negative dimension");
+        }
+        count *= static_cast<std::size_t>(dim);
+    }
+    tensor_.reset(TF_AllocateTensor(deduce_tf_type<T>(), shape_.data(),
+                                    static_cast<int>(shape_.size()),
+                                    count * sizeof(T)));
+}
+
+template<typename T>
+std::span<T> TensorBuilder<T>::data() const {
+    if (!tensor_) {
+        throw std::runtime_error("TensorBuilder was already finished");
+    }
+    return {static_cast<T*>(TF_TensorData(tensor_.get())),
+            TF_TensorByteSize(tensor_.get()) / sizeof(T)};
+}
+
+template<typename T>
+template<std::size_t Rank>
+TensorView<T, Rank> TensorBuilder<T>::view() const {
+    if (shape_.size() != Rank) {
+        throw std::runtime_error("Rank in function view ("
+                                 + std::to_string(Rank)
+                                 + ") does not match tensor rank ("
+                                 + std::to_string(shape_.size()) + ")");
+    }
+    auto extents = typename TensorView<T, Rank>::extents_type {};
+    std::copy(shape_.begin(), shape_.end(), extents.begin());
+    return {data().data(), extents};
+}
+
+template<typename T>
+Tensor TensorBuilder<T>::finish() {
+    if (!tensor_) {
+        throw std::runtime_error("TensorBuilder was already finished");
+    }
+    // The handle shares the buffer with the TF_Tensor
+    return Tensor {tensor_.release()};
+}
+
+}    // namespace cppflow
+
+#endif
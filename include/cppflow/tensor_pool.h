@@ -0,0 +1,298 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_TENSOR_POOL_H__
+#define __CPPFLOW2_TENSOR_POOL_H__
+
+#include "aligned_allocator.h"
+#include "datatype.h"
+#include "tensor.h"
+
+#include <tensorflow/c/tf_tensor.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <new>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace cppflow {
+
+/**
+ * @class TensorPool
+ * @brief Recycles host tensor buffers instead of returning them to malloc
+ *
+ * Tensors made by the pool own a buffer that goes back to a free list of
+ * the thread that releases it, keyed by dtype and byte size, and is handed
+ * out again by the next request for the same dtype and size on that
+ * thread. The tensors are ordinary tensors and can be fed to Model::forward
+ * or to eager ops; TensorFlow returns the buffer once it is done with it.
+ *
+ * Free lists are per thread, so buffers are best allocated and released on
+ * the same threads. Buffers cached by a thread are freed when it exits or
+ * calls trim(). Destroying the pool frees the buffers of the calling thread;
+ * other threads free theirs the next time they release a buffer or miss
+ * their free lists. Tensors produced by TensorFlow, such as the outputs of
+ * Model::forward, are allocated by TensorFlow and are not pooled.
+ */
+class TensorPool {
+public:
+    /**
+     * @param max_cached_bytes Bytes every thread may keep in its free lists,
+     * buffers released beyond it are freed
+     */
+    explicit TensorPool(std::size_t max_cached_bytes = std::size_t {64} << 20);
+
+    /**
+     * Tensors made by the pool stay valid, their buffers are freed once
+     * released
+     */
+    ~TensorPool();
+
+    /**
+     * Creates a tensor in a pooled buffer and lets `fill` write its values
+     * @param shape The shape of the tensor
+     * @param fill Called with a std::span<T> over the uninitialised values
+     */
+    template<typename T, typename Fill>
+    Tensor make(const std::vector<int64_t>& shape, Fill&& fill);
+
+    /**
+     * Creates a tensor in a pooled buffer holding a copy of `values`
+     */
+    template<typename T>
+    Tensor make(std::span<const T> values, const std::vector<int64_t>& shape);
+    template<typename T>
+    Tensor make(const std::vector<T>& values,
+                const std::vector<int64_t>& shape) {
+        return make(std::span<const T> {values}, shape);
+    }
+
+    /**
+     * @return Requests served from a free list
+     */
+    uint64_t hits() const {
+        return state_->hits.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @return Requests that had to allocate a new buffer
+     */
+    uint64_t misses() const {
+        return state_->misses.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Frees the buffers cached by the calling thread
+     */
+    void trim();
+
+    TensorPool(const TensorPool&) = delete;
+    TensorPool& operator=(const TensorPool&) = delete;
+
+private:
+    struct State {
+        uint64_t id;
+        std::size_t max_cached_bytes;
+        std::atomic<uint64_t> hits {0};
+        std::atomic<uint64_t> misses {0};
+        // Cleared by ~TensorPool
+        std::atomic<bool> alive {true};
+    };
+
+    // Sits right before every buffer, which keeps the data aligned
+    struct alignas(kTensorAlignment) Header {
+        std::shared_ptr<State> state;
+        TF_DataType dtype;
+        std::size_t size;
+    };
+
+    struct ThreadCache {
+        std::shared_ptr<State> state;
+        std::map<std::pair<TF_DataType, std::size_t>, std::vector<Header*>>
+            free_lists;
+        std::size_t cached_bytes {0};
+
+        ThreadCache() = default;
+        ThreadCache(const ThreadCache&) = delete;
+        ThreadCache& operator=(const ThreadCache&) = delete;
+        ~ThreadCache();
+    };
+
+    struct ThreadCaches {
+        std::unordered_map<uint64_t, ThreadCache> caches;
+        ~ThreadCaches();
+    };
+
+    static ThreadCaches* thread_caches();
+    static void evict_dead(ThreadCaches& caches);
+    static void destroy(Header* header);
+    static void release(void* data, size_t len, void* arg);
+
+    void* acquire(TF_DataType dtype, std::size_t size);
+
+private:
+    std::shared_ptr<State> state_;
+};
+
+}    // namespace cppflow
+
+
+namespace cppflow {
+
+inline TensorPool::TensorPool(std::size_t max_cached_bytes)
+    : state_(std::make_shared<State>()) {
+    static auto next_id = std::atomic<uint64_t> {0};
+    state_->id = next_id.fetch_add(1, std::memory_order_relaxed);
+    state_->max_cached_bytes = max_cached_bytes;
+}
+
+inline TensorPool::~TensorPool() {
+    state_->alive.store(false, std::memory_order_release);
+    trim();
+}
+
+inline TensorPool::ThreadCache::~ThreadCache() {
+    for (auto& [key, headers] : free_lists) {
+        for (auto* header : headers) {
+            destroy(header);
+        }
+    }
+}
+
+namespace detail {
+
+// Set once the calling thread's caches are gone, buffers released during
+// thread exit are freed directly
+inline thread_local bool thread_caches_destroyed = false;
+
+}    // namespace detail
+
+inline TensorPool::ThreadCaches::~ThreadCaches() {
+    detail::thread_caches_destroyed = true;
+}
+
+inline TensorPool::ThreadCaches* TensorPool::thread_caches() {
+    if (detail::thread_caches_destroyed) {
+        return nullptr;
+    }
+    thread_local auto caches = ThreadCaches {};
+    return &caches;
+}
+
+inline void TensorPool::destroy(Header* header) {
+    header->~Header();
+    ::operator delete(header, std::align_val_t {kTensorAlignment});
+}
+
+inline void* TensorPool::acquire(TF_DataType dtype, std::size_t size) {
+    if (auto* caches = thread_caches()) {
+        auto cache = caches->caches.find(state_->id);
+        if (cache != caches->caches.end()) {
+            auto free_list = cache->second.free_lists.find({dtype, size});
+            if (free_list != cache->second.free_lists.end()
+                && !free_list->second.empty()) {
+                auto* header = free_list->second.back();
+                free_list->second.pop_back();
+                cache->second.cached_bytes -= size;
+                state_->hits.fetch_add(1, std::memory_order_relaxed);
+                return header + 1;
+            }
+        }
+    }
+
+    // Allocating anyway, a good time to drop what dead pools left behind
+    if (auto* caches = thread_caches()) {
+        evict_dead(*caches);
+    }
+
+    state_->misses.fetch_add(1, std::memory_order_relaxed);
+    auto* memory = ::operator new(sizeof(Header) + size,
+                                  std::align_val_t {kTensorAlignment});
+    auto* header = new (memory) Header {state_, dtype, size};
+    return header + 1;
+}
+
+inline void TensorPool::release(void* data, size_t, void*) {
+    auto* header = static_cast<Header*>(data) - 1;
+    const auto& state = *header->state;
+
+    auto* caches = thread_caches();
+    if (caches && !state.alive.load(std::memory_order_acquire)) {
+        evict_dead(*caches);
+    } else if (caches) {
+        auto& cache = caches->caches[state.id];
+        if (!cache.state) {
+            cache.state = header->state;
+        }
+        if (cache.cached_bytes + header->size <= state.max_cached_bytes) {
+            cache.free_lists[{header->dtype, header->size}].emplace_back(
+                header);
+            cache.cached_bytes += header->size;
+            return;
+        }
+    }
+
+    destroy(header);
+}
+
+inline void TensorPool::evict_dead(ThreadCaches& caches) {
+    std::erase_if(caches.caches, [](const auto& entry) {
+        return !entry.second.state->alive.load(std::memory_order_acquire);
+    });
+}
+
+inline void TensorPool::trim() {
+    if (auto* caches = thread_caches()) {
+        caches->caches.erase(state_->id);
+    }
+}
+
+template<typename T, typename Fill>
+Tensor TensorPool::make(const std::vector<int64_t>& shape, Fill&& fill) {
+    static_assert(detail::is_numeric_v<T>,
+                  "Only numeric tensors can be pooled");
+    constexpr auto dtype = deduce_tf_type<T>();
+    auto count = std::size_t {1};
+    for (auto dim : shape) {
+        if (dim < 0) {
+            throw std::runtime_error("Tensor shape has a negative dimension");
+        }
+        count *= static_cast<std::size_t>(dim);
+    }
+
+    auto size = count * sizeof(T);
+    auto* data = acquire(dtype, size);
+    try {
+        fill(std::span<T> {static_cast<T*>(data), count});
+    } catch (...) {
+        release(data, size, nullptr);
+        throw;
+    }
+
+    return Tensor {TF_NewTensor(dtype, shape.data(),
+                                static_cast<int>(shape.size()), data, size,
+                                &TensorPool::release, nullptr)};
+}
+
+template<typename T>
+Tensor TensorPool::make(std::span<const T> values,
+                        const std::vector<int64_t>& shape) {
+    detail::check_element_count(shape, values.size());
+    return make<T>(shape, [&values](std::span<T> data) {
+        std::memcpy(data.data(), values.data(), values.size_bytes());
+    });
+}
+
+}    // namespace cppflow
+
+#endif
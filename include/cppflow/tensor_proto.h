@@ -0,0 +1,255 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_TENSOR_PROTO_H__
+#define __CPPFLOW2_TENSOR_PROTO_H__
+
+#include "proto.h"
+#include "tensor.h"
+
+#include <tensorflow/c/tf_tensor.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace cppflow {
+
+/**
+ * Decodes a serialized tensorflow.TensorShapeProto
+ * @return The dimensions, -1 for unknown ones. Unknown rank gives an
+ * empty vector and sets `unknown_rank`
+ */
+inline std::vector<int64_t> parse_tensor_shape_proto(
+    std::string_view data, bool* unknown_rank = nullptr);
+
+/**
+ * Decodes a serialized tensorflow.TensorProto into a host tensor. Both the
+ * tensor_content and the typed *_val encodings are supported; as in
+ * TensorFlow, a typed list shorter than the shape is padded with its last
+ * value.
+ */
+inline Tensor parse_tensor_proto(std::string_view data);
+
+/**
+ * Encodes a shape as a tensorflow.TensorShapeProto
+ */
+inline std::string serialize_tensor_shape_proto(
+    const std::vector<int64_t>& shape);
+
+/**
+ * Encodes a host tensor as a tensorflow.TensorProto, using tensor_content
+ * for numeric types and string_val for strings
+ */
+inline std::string serialize_tensor_proto(const Tensor& tensor);
+
+}    // namespace cppflow
+
+
+namespace cppflow {
+
+inline std::vector<int64_t> parse_tensor_shape_proto(std::string_view data,
+                                                     bool* unknown_rank) {
+    auto shape = std::vector<int64_t> {};
+    if (unknown_rank) {
+        *unknown_rank = false;
+    }
+
+    auto reader = ProtoReader {data};
+    while (reader.next()) {
+        if (reader.field() == 2) {
+            auto size = int64_t {0};
+            auto dim = ProtoReader {reader.bytes()};
+            while (dim.next()) {
+                if (dim.field() == 1) {
+                    size = dim.int64();
+                }
+            }
+            shape.emplace_back(size);
+        } else if (reader.field() == 3 && unknown_rank) {
+            *unknown_rank = reader.varint() != 0;
+        }
+    }
+
+    return shape;
+}
+
+inline Tensor parse_tensor_proto(std::string_view data) {
+    auto dtype = TF_FLOAT;
+    auto shape = std::vector<int64_t> {};
+    auto content = std::string_view {};
+    auto strings = std::vector<std::string_view> {};
+
+    // Typed values, kept as raw little-endian bits
+    auto values = std::vector<uint64_t> {};
+
+    auto add_values = [&](const ProtoReader& reader, bool fixed,
+                          std::size_t fixed_size) {
+        if (!fixed && reader.type() == ProtoWriter::kVarint) {
+            values.emplace_back(reader.varint());
+            return;
+        }
+        if (fixed && reader.type() != ProtoWriter::kLengthDelimited) {
+            auto bytes = reader.bytes();
+            auto bits = uint64_t {0};
+            std::memcpy(&bits, bytes.data(), bytes.size());
+            values.emplace_back(bits);
+            return;
+        }
+
+        // Packed encoding
+        auto packed = reader.bytes();
+        auto pos = std::size_t {0};
+        while (pos < packed.size()) {
+            if (fixed) {
+                if (packed.size() - pos < fixed_size) {
+                    throw std::runtime_error("Truncated packed TensorProto");
+                }
+                auto bits = uint64_t {0};
+                std::memcpy(&bits, packed.data() + pos, fixed_size);
+                values.emplace_back(bits);
+                pos += fixed_size;
+            } else {
+                values.emplace_back(ProtoReader::read_varint(packed, pos));
+            }
+        }
+    };
+
+    // Field numbers from tensorflow/core/framework/tensor.proto
+    auto reader = ProtoReader {data};
+    while (reader.next()) {
+        switch (reader.field()) {
+            case 1:
+                dtype = static_cast<TF_DataType>(reader.varint());
+                break;
+            case 2:
+                shape = parse_tensor_shape_proto(reader.bytes());
+                break;
+            case 4:
+                content = reader.bytes();
+                break;
+            case 5:    // float_val
+            case 9:    // scomplex_val
+                add_values(reader, true, sizeof(float));
+                break;
+            case 6:     // double_val
+            case 12:    // dcomplex_val
+                add_values(reader, true, sizeof(double));
+                break;
+            case 7:     // int_val
+            case 10:    // int64_val
+            case 11:    // bool_val
+            case 13:    // half_val
+            case 16:    // uint32_val
+            case 17:    // uint64_val
+                add_values(reader, false, 0);
+                break;
+            case 8:
+                strings.emplace_back(reader.bytes());
+                break;
+            default:
+                break;
+        }
+    }
+
+    auto count = std::size_t {1};
+    for (auto dim : shape) {
+        if (dim < 0) {
+            throw std::runtime_error("TensorProto has an unknown dimension");
+        }
+        count *= static_cast<std::size_t>(dim);
+    }
+
+    if (dtype == TF_STRING) {
+        auto tensor = detail::allocate_string_tensor(shape, count);
+        auto* data = static_cast<TF_TString*>(TF_TensorData(tensor.get()));
+        for (std::size_t i = 0; i < count && !strings.empty(); ++i) {
+            const auto& value = strings[std::min(i, strings.size() - 1)];
+            TF_TString_Copy(data + i, value.data(), value.size());
+        }
+        return Tensor {std::move(tensor)};
+    }
+
+    auto element_size = TF_DataTypeSize(dtype);
+    if (element_size == 0) {
+        throw std::runtime_error("TensorProto of type " + to_string(dtype)
+                                 + " cannot be decoded");
+    }
+    auto tensor = std::unique_ptr<TF_Tensor, decltype(&TF_DeleteTensor)>(
+        TF_AllocateTensor(dtype, shape.data(), static_cast<int>(shape.size()),
+                          count * element_size),
+        TF_DeleteTensor);
+    auto* dst = static_cast<char*>(TF_TensorData(tensor.get()));
+
+    if (!content.empty()) {
+        if (content.size() != count * element_size) {
+            throw std::runtime_error(
+                "TensorProto content does not match its shape");
+        }
+        std::memcpy(dst, content.data(), content.size());
+    } else if (values.empty()) {
+        std::memset(dst, 0, count * element_size);
+    } else {
+        // Complex numbers take two values per element
+        auto per_element = dtype == TF_COMPLEX64 || dtype == TF_COMPLEX128
+                               ? std::size_t {2}
+                               : std::size_t {1};
+        auto value_size = element_size / per_element;
+        for (std::size_t i = 0; i < count * per_element; ++i) {
+            auto bits = values[std::min(i, values.size() - 1)];
+            std::memcpy(dst + i * value_size, &bits, value_size);
+        }
+    }
+
+    return Tensor {tensor.release()};
+}
+
+inline std::string serialize_tensor_shape_proto(
+    const std::vector<int64_t>& shape) {
+    auto writer = ProtoWriter {};
+    for (auto dim : shape) {
+        writer.write_message(2, ProtoWriter {}.write_int(1, dim));
+    }
+    return writer.str();
+}
+
+inline std::string serialize_tensor_proto(const Tensor& tensor) {
+    auto handle = tensor.get_tensor();
+    auto dtype = TF_TensorType(handle.get());
+
+    auto shape = std::vector<int64_t>(TF_NumDims(handle.get()));
+    for (std::size_t i = 0; i < shape.size(); ++i) {
+        shape[i] = TF_Dim(handle.get(), static_cast<int>(i));
+    }
+
+    auto writer = ProtoWriter {};
+    writer.write_int(1, dtype);
+    writer.write_bytes(2, serialize_tensor_shape_proto(shape));
+
+    if (dtype == TF_STRING) {
+        const auto* data
+            = static_cast<const TF_TString*>(TF_TensorData(handle.get()));
+        auto count = TF_TensorByteSize(handle.get()) / sizeof(TF_TString);
+        for (std::size_t i = 0; i < count; ++i) {
+            writer.write_bytes(8, {TF_TString_GetDataPointer(data + i),
+                                   TF_TString_GetSize(data + i)});
+        }
+    } else {
+        writer.write_bytes(
+            4, {static_cast<const char*>(TF_TensorData(handle.get())),
+                TF_TensorByteSize(handle.get())});
+    }
+
+    return writer.str();
+}
+
+}    // namespace cppflow
+
+#endif
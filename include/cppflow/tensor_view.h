@@ -0,0 +1,228 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_TENSOR_VIEW_H__
+#define __CPPFLOW2_TENSOR_VIEW_H__
+
+#include <array>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#if __has_include(<mdspan>)
+#include <mdspan>
+#endif
+
+
+namespace cppflow {
+
+/**
+ * @class TensorView
+ * @brief A non-owning, typed view of tensor data with a compile-time rank
+ *
+ * Indexing goes through per-dimension strides, counted in elements, so
+ * sub-views and slices share the data without copying. Views obtained from
+ * Tensor::view() are row-major. The view is only valid while the tensor it
+ * was made from is alive.
+ *
+ *     auto logits = output.view<float, 2>();
+ *     for (std::size_t i = 0; i < logits.extent(0); ++i) {
+ *         auto row = logits[i].span();    // contiguous std::span<float>
+ *     }
+ */
+template<typename T, std::size_t Rank>
+class TensorView {
+public:
+    static_assert(Rank > 0, "Use a span of one element for scalars");
+
+    using element_type = T;
+    using value_type = std::remove_cv_t<T>;
+    using index_type = std::size_t;
+    using extents_type = std::array<std::size_t, Rank>;
+
+    TensorView() = default;
+
+    /**
+     * A row-major view
+     */
+    TensorView(T* data, const extents_type& extents)
+        : data_(data), extents_(extents) {
+        auto stride = std::size_t {1};
+        for (std::size_t i = Rank; i-- > 0;) {
+            strides_[i] = stride;
+            stride *= extents_[i];
+        }
+    }
+
+    TensorView(T* data, const extents_type& extents,
+               const extents_type& strides)
+        : data_(data), extents_(extents), strides_(strides) {
+    }
+
+    // Views of T convert to views of const T
+    template<typename U,
+             std::enable_if_t<std::is_same_v<const U, T>
+                                  && !std::is_same_v<U, T>,
+                              bool> = true>
+    TensorView(const TensorView<U, Rank>& other)
+        : TensorView(other.data(), other.extents(), other.strides()) {
+    }
+
+    static constexpr std::size_t rank() {
+        return Rank;
+    }
+
+    std::size_t extent(std::size_t dim) const {
+        return extents_[dim];
+    }
+
+    std::size_t stride(std::size_t dim) const {
+        return strides_[dim];
+    }
+
+    const extents_type& extents() const {
+        return extents_;
+    }
+
+    const extents_type& strides() const {
+        return strides_;
+    }
+
+    /**
+     * @return The number of elements in the view
+     */
+    std::size_t size() const {
+        auto count = std::size_t {1};
+        for (auto extent : extents_) {
+            count *= extent;
+        }
+        return count;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    T* data() const {
+        return data_;
+    }
+
+    /**
+     * @return true if the elements are laid out row-major without gaps
+     */
+    bool is_contiguous() const {
+        auto stride = std::size_t {1};
+        for (std::size_t i = Rank; i-- > 0;) {
+            if (extents_[i] != 1 && strides_[i] != stride) {
+                return false;
+            }
+            stride *= extents_[i];
+        }
+        return true;
+    }
+
+    template<typename... Indices,
+             std::enable_if_t<sizeof...(Indices) == Rank
+                                  && (std::is_integral_v<Indices> && ...),
+                              bool> = true>
+    T& operator()(Indices... indices) const {
+        auto offset = std::size_t {0};
+        auto dim = std::size_t {0};
+        ((offset += static_cast<std::size_t>(indices) * strides_[dim++]), ...);
+        return data_[offset];
+    }
+
+    /**
+     * @return The sub-view at `index` along the first dimension, or the
+     * element itself for a rank 1 view
+     */
+    decltype(auto) operator[](std::size_t index) const {
+        if constexpr (Rank == 1) {
+            return data_[index * strides_[0]];
+        } else {
+            auto extents = std::array<std::size_t, Rank - 1> {};
+            auto strides = std::array<std::size_t, Rank - 1> {};
+            for (std::size_t i = 1; i < Rank; ++i) {
+                extents[i - 1] = extents_[i];
+                strides[i - 1] = strides_[i];
+            }
+            return TensorView<T, Rank - 1> {data_ + index * strides_[0],
+                                            extents, strides};
+        }
+    }
+
+    /**
+     * Restricts a dimension to [begin, end) keeping the rank
+     * @param dim The dimension to slice
+     * @param begin First index kept
+     * @param end One past the last index kept
+     * @param step Keep every step-th index
+     */
+    TensorView slice(std::size_t dim, std::size_t begin, std::size_t end,
+                     std::size_t step = 1) const {
+        if (dim >= Rank || begin > end || end > extents_[dim] || step == 0) {
+            throw std::out_of_range("Invalid slice [" + std::to_string(begin)
+                                    + ", " + std::to_string(end)
+                                    + ") of dimension " + std::to_string(dim));
+        }
+        auto extents = extents_;
+        auto strides = strides_;
+        extents[dim] = (end - begin + step - 1) / step;
+        strides[dim] *= step;
+        return {data_ + begin * strides_[dim], extents, strides};
+    }
+
+    /**
+     * Restricts the first dimension to [begin, end)
+     */
+    TensorView slice(std::size_t begin, std::size_t end) const {
+        return slice(0, begin, end);
+    }
+
+    /**
+     * @return The elements as a flat span
+     * @throw std::runtime_error if the view is not contiguous
+     */
+    std::span<T> span() const {
+        if (!is_contiguous()) {
+            throw std::runtime_error("TensorView is not contiguous");
+        }
+        return {data_, size()};
+    }
+
+#if defined(__cpp_lib_mdspan)
+    /**
+     * @return A row-major mdspan over the elements
+     * @throw std::runtime_error if the view is not contiguous, use
+     * to_strided_mdspan() for slices
+     */
+    std::mdspan<T, std::dextents<std::size_t, Rank>> to_mdspan() const {
+        if (!is_contiguous()) {
+            throw std::runtime_error("TensorView is not contiguous");
+        }
+        return {data_, std::dextents<std::size_t, Rank> {extents_}};
+    }
+
+    /**
+     * @return An mdspan that keeps the strides of the view
+     */
+    std::mdspan<T, std::dextents<std::size_t, Rank>, std::layout_stride>
+    to_strided_mdspan() const {
+        using Extents = std::dextents<std::size_t, Rank>;
+        return {data_, typename std::layout_stride::template mapping<Extents> {
+                           Extents {extents_}, strides_}};
+    }
+#endif
+
+private:
+    T* data_ {nullptr};
+    extents_type extents_ {};
+    extents_type strides_ {};
+};
+
+}    // namespace cppflow
+
+#endif
@@ -0,0 +1,237 @@
+//
+// cppflow
+//
+
+#ifndef __CPPFLOW2_WARMUP_H__
+#define __CPPFLOW2_WARMUP_H__
+
+#include "proto.h"
+#include "signature.h"
+#include "tensor.h"
+#include "tensor_proto.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+
+namespace cppflow {
+
+struct WarmupOptions {
+    // Signatures run with synthesised inputs, e.g. {"serving_default"}
+    std::vector<std::string> signatures;
+    // Runs per signature
+    int iterations = 3;
+    // Value used for dimensions unknown in the graph, usually the batch
+    int64_t unknown_dim = 1;
+    // Replay assets.extra/tf_serving_warmup_requests if the model has it
+    bool replay_requests = false;
+    // Times every recorded request is replayed
+    int replay_iterations = 1;
+    // Upper bound on the recorded requests read, as in TF Serving
+    std::size_t max_replay_requests = 1000;
+};
+
+/**
+ * A recorded request, with its inputs and outputs as graph tensor names
+ */
+struct WarmupRequest {
+    std::vector<std::tuple<std::string, Tensor>> inputs;
+    std::vector<std::string> outputs;
+};
+
+/**
+ * Reads the records of a TFRecord file. CRCs are not verified
+ * @param max_records Stop after this many records
+ */
+inline std::vector<std::string> read_tfrecords(
+    const std::filesystem::path& filename,
+    std::size_t max_records = static_cast<std::size_t>(-1));
+
+/**
+ * Reads TF Serving warmup requests (a TFRecord file of PredictionLog) and
+ * resolves them against the model signatures. PredictLog and SessionRunLog
+ * entries are supported; classification, regression and multi-inference
+ * logs are skipped.
+ */
+inline std::vector<WarmupRequest> read_warmup_requests(
+    const std::filesystem::path& filename,
+    const std::map<std::string, SignatureDef>& signatures,
+    std::size_t max_requests = 1000);
+
+}    // namespace cppflow
+
+
+namespace cppflow {
+
+namespace detail {
+
+inline WarmupRequest parse_predict_request(
+    std::string_view data,
+    const std::map<std::string, SignatureDef>& signatures) {
+    auto signature_name = std::string {"serving_default"};
+    auto inputs = std::vector<std::tuple<std::string, Tensor>> {};
+    auto filter = std::vector<std::string> {};
+
+    // Field numbers from tensorflow_serving/apis/predict.proto
+    auto reader = ProtoReader {data};
+    while (reader.next()) {
+        switch (reader.field()) {
+            case 1: {
+                auto spec = ProtoReader {reader.bytes()};
+                while (spec.next()) {
+                    if (spec.field() == 3 && !spec.bytes().empty()) {
+                        signature_name = spec.bytes();
+                    }
+                }
+                break;
+            }
+            case 2: {
+                auto name = std::string {};
+                auto tensor = Tensor {};
+                auto entry = ProtoReader {reader.bytes()};
+                while (entry.next()) {
+                    if (entry.field() == 1) {
+                        name = entry.bytes();
+                    } else if (entry.field() == 2) {
+                        tensor = parse_tensor_proto(entry.bytes());
+                    }
+                }
+                inputs.emplace_back(std::move(name), std::move(tensor));
+                break;
+            }
+            case 3:
+                filter.emplace_back(reader.bytes());
+                break;
+            default:
+                break;
+        }
+    }
+
+    auto signature = signatures.find(signature_name);
+    if (signature == signatures.end()) {
+        throw std::runtime_error("Warmup request uses unknown signature \""
+                                 + signature_name + "\"");
+    }
+
+    auto request = WarmupRequest {};
+    for (auto& [name, tensor] : inputs) {
+        auto input = signature->second.inputs.find(name);
+        if (input == signature->second.inputs.end()) {
+            throw std::runtime_error("Warmup request uses unknown input \""
+                                     + name + "\"");
+        }
+        request.inputs.emplace_back(input->second.name, std::move(tensor));
+    }
+    for (const auto& [name, info] : signature->second.outputs) {
+        if (filter.empty()
+            || std::find(filter.begin(), filter.end(), name) != filter.end()) {
+            request.outputs.emplace_back(info.name);
+        }
+    }
+
+    return request;
+}
+
+inline WarmupRequest parse_session_run_request(std::string_view data) {
+    auto request = WarmupRequest {};
+
+    // Field numbers from tensorflow_serving/apis/session_service.proto
+    auto reader = ProtoReader {data};
+    while (reader.next()) {
+        if (reader.field() == 2) {
+            auto name = std::string {};
+            auto tensor = Tensor {};
+            auto feed = ProtoReader {reader.bytes()};
+            while (feed.next()) {
+                if (feed.field() == 1) {
+                    name = feed.bytes();
+                } else if (feed.field() == 2) {
+                    tensor = parse_tensor_proto(feed.bytes());
+                }
+            }
+            request.inputs.emplace_back(std::move(name), std::move(tensor));
+        } else if (reader.field() == 3) {
+            request.outputs.emplace_back(reader.bytes());
+        }
+    }
+
+    return request;
+}
+
+}    // namespace detail
+
+inline std::vector<std::string> read_tfrecords(
+    const std::filesystem::path& filename, std::size_t max_records) {
+    auto file = std::ifstream {filename, std::ios::binary};
+    if (!file) {
+        throw std::runtime_error("Could not open " + filename.string());
+    }
+    auto data = std::string {std::istreambuf_iterator<char> {file}, {}};
+
+    // Every record is: uint64 length, uint32 length crc, data, uint32 crc
+    auto records = std::vector<std::string> {};
+    auto pos = std::size_t {0};
+    while (pos < data.size() && records.size() < max_records) {
+        if (data.size() - pos < 12) {
+            throw std::runtime_error("Truncated TFRecord in "
+                                     + filename.string());
+        }
+        auto length = detail::read_le(data.data() + pos, 8);
+        pos += 12;
+        if (data.size() - pos < length + 4) {
+            throw std::runtime_error("Truncated TFRecord in "
+                                     + filename.string());
+        }
+        records.emplace_back(data.substr(pos, length));
+        pos += length + 4;
+    }
+
+    return records;
+}
+
+inline std::vector<WarmupRequest> read_warmup_requests(
+    const std::filesystem::path& filename,
+    const std::map<std::string, SignatureDef>& signatures,
+    std::size_t max_requests) {
+    auto requests = std::vector<WarmupRequest> {};
+
+    // Field numbers from tensorflow_serving/apis/prediction_log.proto
+    for (const auto& record : read_tfrecords(filename, max_requests)) {
+        auto log = ProtoReader {record};
+        while (log.next()) {
+            if (log.field() != 5 && log.field() != 6) {
+                continue;
+            }
+            // PredictLog and SessionRunLog both hold the request in field 1
+            auto entry = ProtoReader {log.bytes()};
+            while (entry.next()) {
+                if (entry.field() != 1) {
+                    continue;
+                }
+                if (log.field() == 6) {
+                    requests.emplace_back(
+                        detail::parse_predict_request(entry.bytes(),
+                                                      signatures));
+                } else {
+                    requests.emplace_back(
+                        detail::parse_session_run_request(entry.bytes()));
+                }
+            }
+        }
+    }
+
+    return requests;
+}
+
+}    // namespace cppflow
+
+#endif